@@ -0,0 +1,166 @@
+/**
+ * Measures the cost of dispatching a request to its handler, comparing the
+ * previous tokenize-and-lookup dispatch with the switch on packed opcodes
+ * used by CommandManager::handleCommand.
+ *
+ * The handlers only count the requests, so that nothing but the dispatch
+ * itself is measured.
+ *
+ * usage: dispatch [rounds]
+ */
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../common/protocol.hpp"
+
+static const char *const names[] = {"SNG", "TRY", "STR", "SSB", "QUT", "DBG"};
+static const size_t NAMES = sizeof(names) / sizeof(names[0]);
+
+static int handled[NAMES];
+
+// the dispatch as it was before the packed opcodes
+
+class LegacyHandler
+{
+public:
+    size_t _index;
+
+    LegacyHandler(size_t index) : _index(index) {}
+    virtual ~LegacyHandler() {}
+
+    virtual void handle(std::string &, std::string &response) { response = names[_index]; handled[_index]++; }
+};
+
+static std::vector<std::string> legacySplit(std::string input)
+{
+    std::stringstream ss(input);
+    std::string temp;
+    std::vector<std::string> command_split;
+
+    while (std::getline(ss, temp, ' '))
+    {
+        temp.erase(std::remove_if(temp.begin(), temp.end(), ::isspace), temp.end());
+        command_split.push_back(temp);
+    }
+    return command_split;
+}
+
+static std::string legacyDispatch(std::unordered_map<std::string, std::shared_ptr<LegacyHandler>> &handlers,
+                                  std::string message)
+{
+    std::vector<std::string> command_split = legacySplit(message);
+    if (command_split.size() == 0 || command_split[0].length() != 3)
+        return "ERR";
+
+    auto handler = handlers.find(command_split[0]);
+    if (handler == handlers.end())
+        return "ERR";
+
+    std::string response;
+    handler->second->handle(message, response);
+    return response;
+}
+
+// the dispatch of CommandManager::handleCommand
+
+template <size_t I>
+static void handle(std::string_view, std::string &response)
+{
+    response = names[I];
+    handled[I]++;
+}
+
+static void dispatch(std::string_view message, std::string &response)
+{
+    if (message.size() < 3 || (message.size() > 3 && message[3] != ' ' && message[3] != '\n'))
+    {
+        response = "ERR";
+        return;
+    }
+
+    switch (packOpcode(message.data()))
+    {
+    case packOpcode("SNG"):
+        handle<0>(message, response);
+        break;
+    case packOpcode("TRY"):
+        handle<1>(message, response);
+        break;
+    case packOpcode("STR"):
+        handle<2>(message, response);
+        break;
+    case packOpcode("SSB"):
+        handle<3>(message, response);
+        break;
+    case packOpcode("QUT"):
+        handle<4>(message, response);
+        break;
+    case packOpcode("DBG"):
+        handle<5>(message, response);
+        break;
+    default:
+        response = "ERR";
+        break;
+    }
+}
+
+template <typename F>
+static double measure(F function)
+{
+    auto begin = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static void report(const char *name, double seconds, double requests)
+{
+    std::cout << name << ": " << requests / seconds / 1e6 << " M requests/s ("
+              << seconds * 1e9 / requests << " ns/request)" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? std::stoi(argv[1]) : 1000000;
+
+    std::vector<std::string> requests = {"SNG 123456 300\n", "TRY 123456 R G B Y 3\n", "STR 123456\n",
+                                         "SSB\n", "QUT 123456\n", "DBG 123456 300 R G B Y\n", "FOO 123456\n"};
+
+    std::unordered_map<std::string, std::shared_ptr<LegacyHandler>> handlers;
+    for (size_t i = 0; i < NAMES; i++)
+        handlers.insert({names[i], std::make_shared<LegacyHandler>(i)});
+
+    std::string response;
+    for (const std::string &request : requests)
+    {
+        dispatch(request, response);
+        if (response != legacyDispatch(handlers, request))
+        {
+            std::cerr << "Mismatch dispatching " << request;
+            return EXIT_FAILURE;
+        }
+    }
+
+    double total = (double)rounds * (double)requests.size();
+
+    double legacy = measure([&]
+                            {
+        for (int r = 0; r < rounds; r++)
+            for (const std::string &request : requests)
+                response = legacyDispatch(handlers, request); });
+    report("split_command and map lookup", legacy, total);
+
+    double packed = measure([&]
+                            {
+        for (int r = 0; r < rounds; r++)
+            for (const std::string &request : requests)
+                dispatch(request, response); });
+    report("switch on packed opcodes", packed, total);
+
+    return handled[0] > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,129 @@
+/**
+ * Measures how many messages per second the protocol decoders parse and
+ * the encoders write.
+ *
+ * Every request the GS receives and every response the player receives
+ * is decoded in turn, after checking that each one decodes correctly and
+ * that malformed messages are rejected. The responses are then encoded
+ * into a reused buffer, as the GS does.
+ *
+ * usage: protocol [rounds]
+ */
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../common/protocol.hpp"
+
+template <typename F>
+static double measure(F function)
+{
+    auto begin = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static void report(const char *name, double seconds, double messages)
+{
+    std::cout << name << ": " << messages / seconds / 1e6 << " M messages/s ("
+              << seconds * 1e9 / messages << " ns/message)" << std::endl;
+}
+
+static bool rejects(ProtocolCommunication &comm, std::string message)
+{
+    try
+    {
+        comm.decodeRequest(message);
+    }
+    catch (ProtocolException &e)
+    {
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? std::stoi(argv[1]) : 1000000;
+
+    std::string sng = "SNG 123456 300\n", tryRequest = "TRY 123456 R G B Y 3\n",
+                qut = "QUT 123456\n", dbg = "DBG 123456 300 R G O P\n",
+                str = "STR 123456\n", ssb = "SSB\n";
+    std::string rtr = "RTR OK 3 1 2\n", rqt = "RQT OK R G B Y\n",
+                rst = "RST ACT STATE_123456.txt 11 0123456789\n\n";
+
+    StartCommunication startComm;
+    TryCommunication tryComm;
+    QuitCommunication quitComm;
+    DebugCommunication dbgComm;
+    ShowTrialsCommunication stComm;
+    ScoreboardCommunication sbComm;
+
+    tryComm.decodeRequest(tryRequest);
+    dbgComm.decodeRequest(dbg);
+    stComm.decodeResponse(rst);
+    if (tryComm._plid != 123456 || tryComm._key != "R G B Y" || tryComm._nT != 3 ||
+        dbgComm._time != 300 || dbgComm._key != "R G O P" ||
+        stComm._Fname != "STATE_123456.txt" || stComm._Fdata != "0123456789\n" ||
+        !rejects(startComm, "SNG 1234567 300\n") || !rejects(startComm, "SNG 123456 30") ||
+        !rejects(tryComm, "TRY 123456 R G X Y 3\n") || !rejects(quitComm, "QUT 12a456\n") ||
+        !rejects(sbComm, "SSB \n"))
+    {
+        std::cerr << "The decoders do not parse the messages as expected" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    volatile int sink = 0;
+
+    double requests = measure([&]
+                              {
+        for (int r = 0; r < rounds; r++)
+        {
+            startComm.decodeRequest(sng);
+            tryComm.decodeRequest(tryRequest);
+            quitComm.decodeRequest(qut);
+            dbgComm.decodeRequest(dbg);
+            stComm.decodeRequest(str);
+            sbComm.decodeRequest(ssb);
+            sink = sink + startComm._plid + tryComm._nT + dbgComm._time;
+        } });
+    report("requests (SNG TRY QUT DBG STR SSB)", requests, 6.0 * rounds);
+
+    double responses = measure([&]
+                               {
+        for (int r = 0; r < rounds; r++)
+        {
+            tryComm.decodeResponse(rtr);
+            quitComm.decodeResponse(rqt);
+            stComm.decodeResponse(rst);
+            sink = sink + tryComm._nB + stComm._Fsize;
+        } });
+    report("responses (RTR RQT RST)", responses, 3.0 * rounds);
+
+    std::string buffer;
+    tryComm._status = "OK";
+    stComm._status = "ACT";
+    stComm._Fname = "GAME_123456.txt";
+    stComm._Fdata = std::string(MAX_FSIZE, 'x');
+    stComm._Fsize = MAX_FSIZE;
+
+    double encoded = measure([&]
+                             {
+        for (int r = 0; r < rounds; r++)
+        {
+            tryComm.encodeResponse(buffer);
+            sink = sink + (int)buffer.size();
+        } });
+    report("encoded responses (RTR)", encoded, rounds);
+
+    double files = measure([&]
+                           {
+        for (int r = 0; r < rounds; r++)
+        {
+            stComm.encodeResponse(buffer);
+            sink = sink + (int)buffer.size();
+        } });
+    report("encoded responses with a file (RST)", files, rounds);
+
+    return EXIT_SUCCESS;
+}
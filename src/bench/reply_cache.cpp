@@ -0,0 +1,106 @@
+/**
+ * Checks that the GS's reply cache answers retransmissions, and only them.
+ *
+ * Plays from a single UDP socket, so every request has the same source
+ * address: a resent SNG and TRY must get their original replies, while the
+ * SNG of a new game after a QUT, equal byte for byte to the first one, must
+ * start that new game. Exits with EXIT_FAILURE at the first wrong reply.
+ *
+ * usage: reply_cache [-n GSIP] [-p GSport] [-i PLID]
+ */
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "../common/constants.hpp"
+
+static int g_fd;
+static struct addrinfo *g_res;
+
+static std::string exchange(const std::string &request)
+{
+    sendto(g_fd, request.data(), request.size(), 0, g_res->ai_addr, g_res->ai_addrlen);
+
+    char buffer[BUFFER_SIZE];
+    ssize_t n = recv(g_fd, buffer, sizeof(buffer), 0);
+    return n > 0 ? std::string(buffer, (size_t)n) : "(no reply)\n";
+}
+
+/**
+ * @brief Sends a request and checks that its reply starts with expected.
+ * @return The reply.
+ */
+static std::string expect(const std::string &request, const std::string &expected)
+{
+    std::string reply = exchange(request);
+    if (reply.compare(0, expected.size(), expected) != 0)
+    {
+        std::cerr << "FAIL: " << request.substr(0, request.size() - 1) << " -> "
+                  << reply.substr(0, reply.size() - 1) << ", expected " << expected << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return reply;
+}
+
+int main(int argc, char **argv)
+{
+    std::string host = DEFAULT_HOSTNAME, port = DEFAULT_PORT, plid = "654321";
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-n") == 0)
+            host = argv[i + 1];
+        else if (strcmp(argv[i], "-p") == 0)
+            port = argv[i + 1];
+        else if (strcmp(argv[i], "-i") == 0)
+            plid = argv[i + 1];
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &g_res) != 0)
+    {
+        std::cerr << "Unable to resolve " << host << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    g_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct timeval timeout = {2, 0};
+    setsockopt(g_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string sng = "SNG " + plid + " 100\n", qut = "QUT " + plid + "\n";
+    exchange(qut); // the game of an interrupted run
+
+    // a retransmitted SNG and TRY get their original replies
+    expect(sng, "RSG OK");
+    expect(sng, "RSG OK");
+    std::string trial = expect("TRY " + plid + " R G B Y 1\n", "RTR OK 1 ");
+    if (exchange("TRY " + plid + " R G B Y 1\n") != trial)
+    {
+        std::cerr << "FAIL: a retransmitted TRY got another reply" << std::endl;
+        return EXIT_FAILURE;
+    }
+    expect("TRY " + plid + " R R G G 2\n", "RTR OK 2 ");
+    expect(qut, "RQT OK");
+
+    // the same bytes, once the game ended, are the requests of a new game
+    expect(sng, "RSG OK");
+    expect("TRY " + plid + " R G B Y 1\n", "RTR OK 1 ");
+    expect(qut, "RQT OK");
+    expect(sng, "RSG OK");
+    expect(qut, "RQT OK");
+    expect(qut, "RQT OK"); // retransmitted
+    expect("TRY " + plid + " R G B Y 1\n", "RTR NOK");
+
+    std::cout << "reply cache: OK" << std::endl;
+    close(g_fd);
+    freeaddrinfo(g_res);
+    return EXIT_SUCCESS;
+}
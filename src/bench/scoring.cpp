@@ -0,0 +1,135 @@
+/**
+ * Compares the cost of scoring a guess with the previous black()/white()
+ * implementation, the precomputed table and the SIMD batch path.
+ *
+ * Every (guess, secret) pair is scored by each method, after checking
+ * that all of them agree.
+ *
+ * usage: scoring [rounds]
+ */
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "../common/scoring.hpp"
+#include "../common/utils.hpp"
+
+// black() and white() as they were before the table was introduced
+static int legacyBlack(const std::string key, const std::string guess)
+{
+    int count = 0;
+    for (std::string::size_type i = 0; i < key.size(); i++)
+    {
+        if (key[i] == guess[i])
+            count++;
+    }
+    return count;
+}
+
+static int legacyWhite(const std::string key, const std::string guess)
+{
+    int whiteCount = 0;
+    std::unordered_map<char, int> secretFreq, guessFreq;
+
+    for (std::string::size_type i = 0; i < key.size(); i++)
+    {
+        if (key[i] != guess[i])
+        {
+            secretFreq[key[i]]++;
+            guessFreq[guess[i]]++;
+        }
+    }
+    for (const auto &entry : guessFreq)
+    {
+        if (secretFreq.find(entry.first) != secretFreq.end())
+            whiteCount += std::min(entry.second, secretFreq[entry.first]);
+    }
+    return whiteCount;
+}
+
+template <typename F>
+static double measure(F function)
+{
+    auto begin = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static void report(const char *name, double seconds, double pairs)
+{
+    std::cout << name << ": " << pairs / seconds / 1e6 << " M scores/s ("
+              << seconds * 1e9 / pairs << " ns/score)" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? std::stoi(argv[1]) : 10;
+
+    std::vector<std::string> keys;
+    SecretSet secrets;
+    for (int code = 0; code < KEY_CODES; code++)
+    {
+        keys.push_back(unpackKey(code));
+        secrets.add(code);
+    }
+
+    std::vector<uint8_t> blacks(KEY_CODES), whites(KEY_CODES);
+    for (int guess = 0; guess < KEY_CODES; guess++)
+    {
+        scoreMany(guess, secrets, blacks.data(), whites.data());
+        for (int secret = 0; secret < KEY_CODES; secret++)
+        {
+            const std::string &g = keys[(size_t)guess], &s = keys[(size_t)secret];
+            uint8_t score = scoreCodes(guess, secret);
+            if (legacyBlack(s, g) != scoreBlack(score) || legacyWhite(s, g) != scoreWhite(score) ||
+                black(s, g) != scoreBlack(score) || white(s, g) != scoreWhite(score) ||
+                blacks[(size_t)secret] != scoreBlack(score) || whites[(size_t)secret] != scoreWhite(score))
+            {
+                std::cerr << "Mismatch scoring " << g << " against " << s << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    double pairs = (double)KEY_CODES * KEY_CODES;
+    volatile int sink = 0;
+
+    double legacy = measure([&]
+                            {
+        for (int guess = 0; guess < KEY_CODES; guess++)
+            for (int secret = 0; secret < KEY_CODES; secret++)
+                sink = sink + legacyBlack(keys[(size_t)secret], keys[(size_t)guess]) +
+                       legacyWhite(keys[(size_t)secret], keys[(size_t)guess]); });
+    report("legacy black()+white()", legacy, pairs);
+
+    double strings = measure([&]
+                             {
+        for (int r = 0; r < rounds; r++)
+            for (int guess = 0; guess < KEY_CODES; guess++)
+                for (int secret = 0; secret < KEY_CODES; secret++)
+                    sink = sink + black(keys[(size_t)secret], keys[(size_t)guess]) +
+                           white(keys[(size_t)secret], keys[(size_t)guess]); });
+    report("black()+white() on the table", strings, pairs * rounds);
+
+    double table = measure([&]
+                           {
+        for (int r = 0; r < rounds; r++)
+            for (int guess = 0; guess < KEY_CODES; guess++)
+                for (int secret = 0; secret < KEY_CODES; secret++)
+                    sink = sink + scoreCodes(guess, secret); });
+    report("scoreCodes() on packed keys", table, pairs * rounds);
+
+    double simd = measure([&]
+                          {
+        for (int r = 0; r < rounds; r++)
+            for (int guess = 0; guess < KEY_CODES; guess++)
+            {
+                scoreMany(guess, secrets, blacks.data(), whites.data());
+                sink = sink + blacks[0];
+            } });
+    report("scoreMany() batch", simd, pairs * rounds);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+/**
+ * Measures how many TCP request/response exchanges per second the GS serves.
+ *
+ * Keeps a fixed number of connections in flight, each sending one request
+ * ("SSB" by default) and reading the response until the server closes it.
+ * Run it against `./GS --tcp-model=fork`, `--tcp-model=epoll` and
+ * `--tcp-model=pool` to compare the models. With -a N each connection is kept alive (KAL) and
+ * carries N pipelined requests, whose framed responses are read back.
+ *
+ * usage: tcp_connections [-n GSIP] [-p GSport] [-c total] [-k in flight]
+ *                        [-r request] [-a requests per connection]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../common/constants.hpp"
+
+struct Exchange
+{
+    size_t _sent = 0;
+    size_t _received = 0;
+    std::string _in;        // Kept-alive responses not yet parsed
+    long _responses = 0;    // Kept-alive responses fully received
+    bool _keepAlive = false; // RKA OK received
+};
+
+static std::string g_request = "SSB\n";
+static std::string g_payload; // What each connection sends
+static long g_perConnection = 1;
+static struct addrinfo *g_res;
+
+static int openConnection(int epfd, std::unordered_map<int, Exchange> &inflight)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd == -1)
+        return -1;
+
+    if (connect(fd, g_res->ai_addr, g_res->ai_addrlen) == -1 && errno != EINPROGRESS)
+    {
+        close(fd);
+        return -1;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+    inflight[fd] = Exchange();
+    return fd;
+}
+
+// consumes the RKA OK line and the framed responses received so far
+static void parseFrames(Exchange &ex)
+{
+    size_t delimiter;
+    while ((delimiter = ex._in.find('\n')) != std::string::npos)
+    {
+        if (!ex._keepAlive)
+        {
+            ex._keepAlive = true;
+            ex._in.erase(0, delimiter + 1);
+            continue;
+        }
+
+        size_t size = std::stoul(ex._in.substr(0, delimiter));
+        if (ex._in.size() < delimiter + 1 + size)
+            return;
+        ex._in.erase(0, delimiter + 1 + size);
+        ex._responses++;
+    }
+}
+
+// returns true when the exchange finished (or failed) and fd was closed
+static bool progress(int fd, Exchange &ex, size_t &bytes)
+{
+    while (ex._sent < g_payload.size())
+    {
+        ssize_t n = write(fd, g_payload.data() + ex._sent, g_payload.size() - ex._sent);
+        if (n == -1)
+        {
+            if (errno == EAGAIN || errno == ENOTCONN)
+                return false;
+            close(fd);
+            return true;
+        }
+        ex._sent += (size_t)n;
+    }
+
+    char buffer[4096];
+    while (true)
+    {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0)
+        {
+            ex._received += (size_t)n;
+            if (g_perConnection > 1)
+            {
+                ex._in.append(buffer, (size_t)n);
+                parseFrames(ex);
+            }
+            if (g_perConnection == 1 || ex._responses < g_perConnection)
+                continue;
+            // all answered: the server keeps the connection, so close it here
+        }
+        else if (n == -1 && errno == EAGAIN)
+            return false;
+        bytes += ex._received;
+        close(fd);
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string host = DEFAULT_HOSTNAME, port = DEFAULT_PORT;
+    long total = 10000, concurrency = 64;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-n") == 0)
+            host = argv[i + 1];
+        else if (strcmp(argv[i], "-p") == 0)
+            port = argv[i + 1];
+        else if (strcmp(argv[i], "-c") == 0)
+            total = std::stol(argv[i + 1]);
+        else if (strcmp(argv[i], "-k") == 0)
+            concurrency = std::stol(argv[i + 1]);
+        else if (strcmp(argv[i], "-r") == 0)
+            g_request = std::string(argv[i + 1]) + "\n";
+        else if (strcmp(argv[i], "-a") == 0)
+            g_perConnection = std::max(1L, std::stol(argv[i + 1]));
+    }
+
+    g_payload = g_perConnection > 1 ? "KAL\n" : "";
+    for (long i = 0; i < g_perConnection; i++)
+        g_payload += g_request;
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &g_res) != 0)
+    {
+        std::cerr << "Unable to resolve " << host << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int epfd = epoll_create1(0);
+    std::unordered_map<int, Exchange> inflight;
+    long started = 0, finished = 0;
+    size_t bytes = 0;
+
+    auto begin = std::chrono::steady_clock::now();
+    while (finished < total)
+    {
+        while ((long)inflight.size() < concurrency && started < total)
+        {
+            if (openConnection(epfd, inflight) == -1)
+                break;
+            started++;
+        }
+
+        struct epoll_event events[256];
+        int n = epoll_wait(epfd, events, 256, 1000);
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            auto ex = inflight.find(fd);
+            if (ex != inflight.end() && progress(fd, ex->second, bytes))
+            {
+                inflight.erase(ex);
+                finished++;
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    double requests = (double)(finished * g_perConnection);
+    std::cout << finished << " connections in " << seconds << " s: "
+              << (double)finished / seconds << " connections/s, "
+              << requests / seconds << " requests/s, "
+              << (double)bytes / requests << " bytes/response" << std::endl;
+
+    freeaddrinfo(g_res);
+    close(epfd);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+/**
+ * Measures the latency of the GS's UDP requests, as percentiles.
+ *
+ * Plays a fixed number of games at once, each from its own socket and PLID,
+ * cycling through SNG, TRY and QUT with one request in flight per game, and
+ * times every request until its reply. Run it against
+ * `./GS --io-engine=blocking` and `./GS --io-engine=uring` to compare both
+ * engines, with --ip-rate=0 so the requests are not rate limited.
+ *
+ * usage: udp_latency [-n GSIP] [-p GSport] [-c total] [-k games in flight]
+ *                    [-i first PLID]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../common/constants.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Player
+{
+    int _fd;
+    std::string _plid;
+    int _step = 0;           // 0: SNG, 1: TRY, 2: QUT
+    Clock::time_point _sent; // When the request in flight was sent
+    bool _waiting = false;   // Whether a request is in flight
+};
+
+static struct addrinfo *g_res;
+
+static void sendRequest(Player &player)
+{
+    std::string request;
+    if (player._step == 0)
+        request = "SNG " + player._plid + " 600\n";
+    else if (player._step == 1)
+        request = "TRY " + player._plid + " R G B Y 1\n";
+    else
+        request = "QUT " + player._plid + "\n";
+
+    player._sent = Clock::now();
+    sendto(player._fd, request.data(), request.size(), 0, g_res->ai_addr, g_res->ai_addrlen);
+}
+
+static double percentile(std::vector<double> &sorted, double p)
+{
+    size_t index = (size_t)(p / 100.0 * (double)(sorted.size() - 1));
+    return sorted[index];
+}
+
+int main(int argc, char **argv)
+{
+    std::string host = DEFAULT_HOSTNAME, port = DEFAULT_PORT;
+    long total = 100000, concurrency = 64, firstPlid = 300000;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-n") == 0)
+            host = argv[i + 1];
+        else if (strcmp(argv[i], "-p") == 0)
+            port = argv[i + 1];
+        else if (strcmp(argv[i], "-c") == 0)
+            total = std::stol(argv[i + 1]);
+        else if (strcmp(argv[i], "-k") == 0)
+            concurrency = std::max(1L, std::stol(argv[i + 1]));
+        else if (strcmp(argv[i], "-i") == 0)
+            firstPlid = std::stol(argv[i + 1]);
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &g_res) != 0)
+    {
+        std::cerr << "Unable to resolve " << host << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int epfd = epoll_create1(0);
+    std::vector<Player> players((size_t)concurrency);
+    for (size_t i = 0; i < players.size(); i++)
+    {
+        players[i]._fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        players[i]._plid = std::to_string(firstPlid + (long)i);
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u64 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, players[i]._fd, &event);
+    }
+
+    // the games of an interrupted run are quit first, untimed
+    for (auto &player : players)
+    {
+        player._step = 2;
+        sendRequest(player);
+    }
+    char buffer[BUFFER_SIZE];
+    auto deadline = Clock::now() + std::chrono::seconds(1);
+    for (size_t answered = 0; answered < players.size() && Clock::now() < deadline;)
+    {
+        struct epoll_event events[256];
+        int n = epoll_wait(epfd, events, 256, 100);
+        for (int e = 0; e < n; e++)
+            if (recv(players[events[e].data.u64]._fd, buffer, sizeof(buffer), 0) > 0)
+                answered++;
+    }
+
+    std::vector<double> latencies; // Microseconds
+    latencies.reserve((size_t)total);
+    long sent = 0, lost = 0;
+
+    auto begin = Clock::now();
+    for (auto &player : players)
+    {
+        player._step = 0;
+        player._waiting = sent++ < total;
+        if (player._waiting)
+            sendRequest(player);
+    }
+
+    while ((long)latencies.size() < total)
+    {
+        struct epoll_event events[256];
+        int n = epoll_wait(epfd, events, 256, 100);
+        auto now = Clock::now();
+        for (int e = 0; e < n; e++)
+        {
+            Player &player = players[events[e].data.u64];
+            if (recv(player._fd, buffer, sizeof(buffer), 0) <= 0 || !player._waiting)
+                continue;
+
+            latencies.push_back(
+                (double)std::chrono::duration_cast<std::chrono::nanoseconds>(now - player._sent).count() / 1000.0);
+            player._step = (player._step + 1) % 3;
+            player._waiting = sent++ < total;
+            if (player._waiting)
+                sendRequest(player);
+        }
+
+        // a reply lost for a second: the request is sent again
+        for (auto &player : players)
+            if (player._waiting && now - player._sent > std::chrono::seconds(1))
+            {
+                lost++;
+                sendRequest(player);
+            }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << latencies.size() << " requests in " << seconds << " s: "
+              << (double)latencies.size() / seconds << " requests/s, " << lost << " resent" << std::endl;
+    std::cout << "latency (us): p50 " << percentile(latencies, 50) << ", p90 " << percentile(latencies, 90)
+              << ", p99 " << percentile(latencies, 99) << ", p99.9 " << percentile(latencies, 99.9)
+              << ", max " << latencies.back() << std::endl;
+
+    for (auto &player : players)
+        close(player._fd);
+    freeaddrinfo(g_res);
+    close(epfd);
+    return EXIT_SUCCESS;
+}
@@ -2,7 +2,7 @@
 #include "player.hpp"
 #include <iostream>
 
-extern bool is_exiting; // flag to indicate whether the application is exiting
+extern std::atomic<bool> is_exiting; // flag to indicate whether the application is exiting
 
 void CommandManager::addCommand(std::shared_ptr<CommandHandler> command)
 {
@@ -377,7 +377,7 @@ void ShowTrialsCommand::handle(std::string args, Client &state)
       std::cout << "Invalid filename - max of 24 alphanumerical characters";
       return;
     }
-    if (stComm._Fsize > MAX_FSIZE)
+    if (stComm._Fsize > MAX_STREAM_FSIZE)
     {
       std::cout << "File too big.";
       return;
@@ -411,7 +411,7 @@ void ScoreboardCommand::handle(std::string args, Client &state)
       std::cout << "Invalid filename - max of 24 alphanumerical characters";
       return;
     }
-    if (sbComm._Fsize > MAX_FSIZE)
+    if (sbComm._Fsize > MAX_STREAM_FSIZE)
     {
       std::cout << "File too big.";
       return;
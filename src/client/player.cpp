@@ -2,7 +2,7 @@
 #include "player.hpp"
 #include "commands.hpp"
 
-extern bool is_exiting;
+extern std::atomic<bool> is_exiting;
 
 int main(int argc, char *argv[])
 {
@@ -148,20 +148,11 @@ Client::Client(int argc, char **argv)
 
 void Client::processRequest(ProtocolCommunication &comm)
 {
-    std::string reqMessage = comm.encodeRequest();
+    comm.encodeRequest(_request);
     std::string resMessage = "";
 
     if (comm.isTcp())   // If the communication is TCP, use TCP
-    { 
-        TCPInfo tcp(_gsip, _gsport);
-        try {
-            tcp.send(reqMessage);           // send request message
-            resMessage = tcp.receive();     // receive response
-        } catch (...) {
-            tcp.closeTcpSocket();
-        }
-        tcp.closeTcpSocket();
-    }
+        resMessage = exchangeTcp(_request);
 
     else    // If the communication is UDP, use UDP
     { 
@@ -170,7 +161,7 @@ void Client::processRequest(ProtocolCommunication &comm)
         while (triesLeft > 0) {
             --triesLeft;
             try {
-                udp.send(reqMessage);           // send request message
+                udp.send(_request);           // send request message
                 resMessage = udp.receive();     // receive response
                 if (resMessage != "")           // response received
                     break;
@@ -183,11 +174,57 @@ void Client::processRequest(ProtocolCommunication &comm)
 
     }
 
-    StreamMessage resStreamMessage(resMessage); // Create a StreamMessage from the response
+    comm.decodeResponse(resMessage); // Decode the response
+}
 
-    comm.decodeResponse(resStreamMessage); // Decode the response
+
+std::unique_ptr<TCPInfo> Client::openKeepAlive()
+{
+    auto tcp = std::make_unique<TCPInfo>(_gsip, _gsport);
+
+    KeepAliveCommunication kaComm;
+    std::string message;
+    kaComm.encodeRequest(message);
+    tcp->send(message);
+
+    try {
+        kaComm.decodeResponse(tcp->receiveLine());
+    } catch (ProtocolException &e) {
+        _keepAlive = false; // e.g. "ERR" from a server forking per connection
+        return nullptr;
+    }
+    return tcp;
 }
 
+std::string Client::exchangeTcp(std::string &request)
+{
+    // the server closes idle connections, so a failed exchange on the
+    // kept-alive connection is retried once on a new one
+    for (int attempt = 0; attempt < 2 && _keepAlive; attempt++) {
+        try {
+            if (_tcp == nullptr)
+                _tcp = openKeepAlive();
+            if (_tcp == nullptr)
+                break;
+
+            _tcp->send(request);
+            return _tcp->receiveFrame();
+        } catch (...) {
+            _tcp.reset();
+        }
+    }
+
+    std::string response;
+    TCPInfo tcp(_gsip, _gsport);
+    try {
+        tcp.send(request);           // send request message
+        response = tcp.receive();    // receive response
+    } catch (...) {
+        tcp.closeTcpSocket();
+    }
+    tcp.closeTcpSocket();
+    return response;
+}
 
 void Client::writeFile(std::string fName, std::string &data) {
     try {
@@ -3,6 +3,7 @@
 
 #include <csignal>
 #include <iostream>
+#include <memory>
 // #include <filesystem>
 
 #include <signal.h>
@@ -11,6 +12,7 @@
 #include "../common/constants.hpp"
 #include "../common/utils.hpp"
 #include "../common/protocol.hpp"
+#include "player_info.hpp"
 // #include "commands.hpp"
 
 class Player
@@ -40,6 +42,22 @@ private:
   std::string _gsip = DEFAULT_HOSTNAME;
   std::string _gsport = DEFAULT_PORT;
   std::string _path = GAME_FILES_DIR;
+  std::string _request; // Reused to encode every request
+  std::unique_ptr<TCPInfo> _tcp; // Kept-alive connection for the TCP requests, if open
+  bool _keepAlive = true;        // Whether the server accepts kept-alive connections
+
+  /**
+   * @brief Opens a connection and asks the server to keep it alive.
+   * @return The connection, or nullptr if the server does not keep
+   * connections alive, in which case _keepAlive is cleared.
+   */
+  std::unique_ptr<TCPInfo> openKeepAlive();
+
+  /**
+   * @brief Sends a TCP request and receives its response, on the kept-alive
+   * connection if possible, or else on a connection of its own.
+   */
+  std::string exchangeTcp(std::string &request);
 
 public:
   Player _player;
@@ -163,6 +163,51 @@ std::string TCPInfo::receive()
 }
 
 
+bool TCPInfo::fill()
+{
+    char buffer[BUFFER_SIZE];
+
+    ssize_t n = read(_fd, buffer, BUFFER_SIZE);
+    if (n == -1)
+        throw SocketException();
+
+    _pending.append(buffer, (size_t)n);
+    return n != 0;
+}
+
+std::string TCPInfo::receiveLine()
+{
+    size_t delimiter;
+    while ((delimiter = _pending.find('\n')) == std::string::npos && fill())
+        ;
+
+    // without a delimiter, whatever arrived before the connection closed
+    size_t length = delimiter == std::string::npos ? _pending.size() : delimiter + 1;
+    std::string message = _pending.substr(0, length);
+    _pending.erase(0, length);
+    return message;
+}
+
+std::string TCPInfo::receiveFrame()
+{
+    // the size is at most MAX_STREAM_FSIZE and a short header: 9 digits
+    std::string header = receiveLine();
+    if (header.size() < 2 || header.size() > 10 || header.back() != '\n' ||
+        header.find_first_not_of("0123456789") != header.size() - 1)
+        throw SocketException();
+
+    size_t size = std::stoul(header);
+    while (_pending.size() < size)
+    {
+        if (!fill())
+            throw SocketException(); // closed before the whole message arrived
+    }
+
+    std::string message = _pending.substr(0, size);
+    _pending.erase(0, size);
+    return message;
+}
+
 void TCPInfo::closeTcpSocket() {
     // freeaddrinfo(_res);
     if (close(_fd) != 0) {
@@ -67,6 +67,13 @@ class TCPInfo {
     int _fd;                 // The file descriptor of the socket
     struct addrinfo _hints;  // The address flags
     struct addrinfo *_res;   // The address info
+    std::string _pending;    // Bytes received and not yet returned
+
+    /**
+     * @brief Reads what is available into _pending.
+     * @return false if the server closed the connection.
+     */
+    bool fill();
 
   public:
     /**
@@ -94,6 +101,19 @@ class TCPInfo {
      */
     std::string receive();
 
+    /**
+     * @brief Receives a message up to its delimiter, or up to the end of the connection.
+     * @return The received message as a string.
+     */
+    std::string receiveLine();
+
+    /**
+     * @brief Receives a message preceded by its size and a delimiter, as
+     * sent on a kept-alive connection.
+     * @return The received message as a string, without its size.
+     */
+    std::string receiveFrame();
+
     void closeTcpSocket();
 
 };
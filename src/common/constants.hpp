@@ -5,12 +5,19 @@
 #define DEFAULT_PORT "58013" // 5800 + GROUP NUMBER
 
 #define MAX_TRIALS 8
+#define KEY_SIZE 4
+#define KEY_COLORS 6
+#define KEY_CODES 1296 // KEY_COLORS ^ KEY_SIZE
 #define PLID_MAX_SIZE 6
+#define PLID_COUNT 1000000 // 10^PLID_MAX_SIZE
 #define MAX_PLAYTIME 600
 #define MAX_PLAYTIME_DIGITS 3
 
+#define SCOREBOARD_SIZE 10
+
 #define MAX_FNAME 24
 #define MAX_FSIZE 1024
+#define MAX_STREAM_FSIZE (64 * 1024 * 1024) // Files sent from disk, see _FdataFollows
 #define MAX_TRANSMISSION 4
 
 #define BUFFER_SIZE 128
@@ -21,12 +28,63 @@
 #define RESEND_TRIES 5
 #define TCP_READ_TIMEOUT 30
 #define TCP_WRITE_TIMEOUT 300
+#define TCP_REQUEST_DEADLINE 5 // Seconds for a whole TCP request to arrive
+#define TCP_MAX_REQUEST 128    // Bytes, including the delimiter
+#define TCP_MAX_PIPELINE 4096  // Bytes of pipelined requests buffered per connection
+#define TCP_KEEPALIVE_TIMEOUT 30 // Seconds a kept-alive connection may wait for a request
 #define SERVER_TIMEOUT 300
+#define UPGRADE_ENV "GS_UPGRADE_FD" // Set to the handoff channel in a process started by an upgrade
+#define UPGRADE_TIMEOUT 30          // Seconds the new process has to load the games
+#define UPGRADE_DRAIN_TIMEOUT 60    // Seconds the old process serves its open connections
+#define SERVER_POLL_TIMEOUT_MS 1000
+
+#define TCP_LISTEN_BACKLOG 1024
+#define REACTOR_MAX_EVENTS 256
+
+#define TCP_POOL_THREADS 8     // Worker threads of the pool TCP model
+#define TCP_POOL_MAX_THREADS 256
+#define TCP_POOL_QUEUE 1024    // Accepted connections waiting for a worker, a power of two
+
+#define UDP_BATCH_SIZE 16
+#define UDP_BATCH_MAX 1024
+#define UDP_BATCH_WAIT_US 0
+#define UDP_MAX_WORKERS 64
+
+#define PERSISTENCE_URING_ENTRIES 64 // Game file writes submitted together with the io_uring engine
+
+#define REPLY_CACHE_SIZE 65536 // UDP replies kept for retransmissions
+#define REPLY_CACHE_SHARDS 16
+#define REPLY_CACHE_TTL (SOCKETS_UDP_TIMEOUT * RESEND_TRIES) // Seconds the player keeps resending
+
+#define ADMISSION_IP_RATE 1000   // UDP requests per second per source IP
+#define ADMISSION_PLID_RATE 20   // UDP requests per second per PLID
+#define ADMISSION_BURST_SECONDS 2 // Seconds of requests a bucket holds
+#define ADMISSION_QUEUE_LIMIT 90  // Percentage of the UDP receive buffer
+#define ADMISSION_TABLE_BITS 12  // 4096 buckets per table
+#define ADMISSION_LOCK_STRIPES 16
+
+#define PLAYER_LOCK_STRIPES 64
+#define PLAYER_TABLE_BLOCK 1000
+
+#define TIMER_WHEEL_BITS 6   // 64 slots per level
+#define TIMER_WHEEL_LEVELS 3 // 64^3 seconds, about 3 days
+#define GAME_EXPIRY_TICK_MS 1000
 
 #define GAME_FILES_DIR "./src/game_files/"
 #define FILES_DIR "./src/gamedata/"
 #define GAMES_DIR "./src/gamedata/GAMES/"
 #define SCORES_DIR "./src/gamedata/SCORES/"
+#define JOURNAL_DIR "./src/gamedata/JOURNAL/"
+#define SHEETS_DIR "./src/gamedata/SHEETS/" // STR/SSB bodies, streamed from disk
+#define GAMES_INDEX ".index" // In each GAMES_DIR/<PLID>, the player's finished games
+
+#define JOURNAL_RECORD_SIZE 32
+#define JOURNAL_SEGMENT_SIZE (4 * 1024 * 1024)
+#define JOURNAL_COMMIT_WINDOW_US 1000
+#define JOURNAL_SYNC_INTERVAL_MS 1000
+
+#define GAME_SEGMENT_PREFIX "/gs_games_" // Shared memory name, followed by a hash of FILES_DIR
+#define GAME_SEGMENT_SLOTS 65536         // Most ongoing games kept across restarts
 
 #define WIN_CODE "W"
 #define FAIL_CODE "F"
@@ -1,189 +1,28 @@
 #include "protocol.hpp"
 
-char ProtocolCommunication::readChar(std::string &message, size_t pos)
+int requestPlid(std::string_view request)
 {
-    return message[pos];
-}
-
-char ProtocolCommunication::readChar(MessageSource &message)
-{
-    char c = (char)message.get(); // get() returns an int, so we need to cast it to char
-
-    return c;
-}
-
-void ProtocolCommunication::readChar(MessageSource &message, char expected)
-{
-    if (readChar(message) != expected)
-    {
-        // if the read char is not the expected one, throw an exception
-        throw ProtocolViolationException();
-    }
-}
+    if (request.size() < 4 + PLID_MAX_SIZE || request[3] != ' ')
+        return -1;
 
-char ProtocolCommunication::readChar(MessageSource &message,
-                                     std::vector<char> options)
-{
-    char c = readChar(message); // read a char
-
-    for (auto option : options)
+    int plid = 0;
+    for (size_t i = 4; i < 4 + PLID_MAX_SIZE; i++)
     {
-        // check if the read char is one of the options
-        if (option == c)
-        {
-            return c;
-        }
+        if (request[i] < '0' || request[i] > '9')
+            return -1;
+        plid = plid * 10 + (request[i] - '0');
     }
-    // if not, throw an exception
-    throw ProtocolViolationException();
-}
-
-void ProtocolCommunication::readDelimiter(MessageSource &message)
-{
-    readChar(message, '\n'); // read the delimiter
-}
-
-void ProtocolCommunication::readSpace(MessageSource &message)
-{
-    readChar(message, ' '); // read a space
-}
-
-std::string ProtocolCommunication::readString(MessageSource &message)
-{
-    // To read an arbitrarily sized string, just read a string with a limit of
-    // size equal to the maximum possible.
-    return readString(message, std::string::npos);
-}
-
-std::string ProtocolCommunication::readString(MessageSource &message, size_t n)
-{
-    std::string result;
-
-    for (size_t i = 0; i < n; i++)
-    { // read n chars
-        // Read a char
-        char c = (char)message.get();
-
-        if (c == ' ' || c == '\n')
-        {
-            // If the char is a space or a delimiter, put it back in the stream
-            message.unget();
-            break;
-        }
-
-        // Otherwise, add it to the result
-        result.push_back(c);
-    }
-
-    return result;
-}
-
-void ProtocolCommunication::readString(MessageSource &message, std::string expected)
-{
-    if (readString(message) != expected)
-    {
-        // if the read string is not the expected one, throw an exception
-        throw ProtocolViolationException();
-    }
-}
-
-std::string ProtocolCommunication::readString(MessageSource &message,
-                                              std::vector<std::string> options)
-{
-
-    // Read a string
-    std::string string = readString(message);
-
-    for (auto option : options)
-    {
-        // Check if the read string is one of the options
-        if (string == option)
-        {
-            return string;
-        }
-    }
-    // If not, throw an exception
-    throw ProtocolViolationException();
-}
-
-int ProtocolCommunication::readInt(MessageSource &message)
-{
-    std::string string = readString(message);
-
-    // Check if string only contains digits
-    if (is_not_numeric(string))
-    {
-        throw ProtocolViolationException();
-    }
-
-    return stoi(string); // Convert string to int
-}
-
-int ProtocolCommunication::readInt(MessageSource &message, size_t size)
-{
-    std::string string = readString(message, size);
-
-    // Check if string only contains digits
-    if (is_not_numeric(string))
-    {
-        throw ProtocolViolationException();
-    }
-
-    return stoi(string); // Convert string to int
-}
-
-int ProtocolCommunication::readPlid(MessageSource &message)
-{
-    int plid = readInt(message, PLID_MAX_SIZE); // Read a string
-
     return plid;
 }
 
-int ProtocolCommunication::readTime(MessageSource &message)
+void ProtocolCommunication::checkDecoded(MessageCursor &cursor)
 {
-    int time = readInt(message, MAX_PLAYTIME_DIGITS); // Read a string
-
-    return time;
-}
-
-std::string ProtocolCommunication::readKey(MessageSource &message)
-{
-    std::vector<char> colors = {'R', 'G', 'B', 'Y', 'O', 'P'};
-
-    char c1 = readChar(message, colors);
-    readSpace(message);
-    char c2 = readChar(message);
-    readSpace(message);
-    char c3 = readChar(message);
-    readSpace(message);
-    char c4 = readChar(message);
-
-    return std::string(1, c1) + " " + c2 + " " + c3 + " " + c4;
-}
-
-void ProtocolCommunication::readIdentifier(MessageSource &message,
-                                           std::string identifier)
-{
-    std::string identifierReceived = readString(message, 3); // Read a string
-
-    if (identifierReceived == PROTOCOL_ERROR)
-    {
-        // If the identifier is the error identifier, throw an exception
+    if (cursor.isErrorMessage())
         throw ProtocolMessageErrorException();
-    }
-    else if (identifierReceived != identifier)
-    {
-        // If the identifier is not the expected one, throw an exception
+    if (!cursor.good())
         throw ProtocolViolationException();
-    }
 }
 
-// std::string ProtocolCommunication::readfileName(MessageSource &message) {
-//     std::string filename = readString(message, MAX_FNAME);
-
-//     return filename;
-// }
-
 void ProtocolCommunication::writeChar(std::string &message, char c)
 {
     try
@@ -206,23 +45,21 @@ void ProtocolCommunication::writeSpace(std::string &message)
     writeChar(message, ' '); // write a space
 }
 
-void ProtocolCommunication::writeString(std::string &message, std::string string)
+void ProtocolCommunication::writeString(std::string &message, std::string_view string)
 {
-    for (auto c : string)
-    { // write each char of the string
-        writeChar(message, c);
-    }
+    message.append(string.data(), string.size());
 }
 
 void ProtocolCommunication::writeInt(std::string &message, int number)
 {
-    // convert the number to a string
-    std::string value = std::to_string(number);
+    // convert the number in place, without a temporary string
+    char digits[16];
+    auto result = std::to_chars(digits, digits + sizeof(digits), number);
 
-    writeString(message, value); // write the string
+    message.append(digits, (size_t)(result.ptr - digits));
 }
 
-void ProtocolCommunication::writeFileName(std::string &message, std::string fileName)
+void ProtocolCommunication::writeFileName(std::string &message, std::string_view fileName)
 {
     if (fileName.length() > MAX_FNAME)
         throw ProtocolViolationException();
@@ -230,9 +67,18 @@ void ProtocolCommunication::writeFileName(std::string &message, std::string file
     writeString(message, fileName);
 }
 
-std::string StartCommunication::encodeRequest()
+void ProtocolCommunication::writeFile(std::string &message, std::string_view data, int size)
+{
+    if (size < 0 || (size_t)size > data.size())
+        throw ProtocolViolationException();
+
+    // a single copy of the whole file
+    message.append(data.data(), (size_t)size);
+}
+
+void StartCommunication::encodeRequest(std::string &message)
 {
-    std::string message;
+    message.clear();
 
     writeString(message, "SNG"); // write identifier "SNG"
     writeSpace(message);
@@ -240,50 +86,53 @@ std::string StartCommunication::encodeRequest()
     writeSpace(message);
     writeInt(message, _time);
     writeDelimiter(message); // delimiter at the end
-
-    return message;
 }
 
-void StartCommunication::decodeRequest(MessageSource &message)
+void StartCommunication::decodeRequest(std::string_view message)
 {
-    readIdentifier(message, "SNG");
-    readSpace(message);
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("SNG");
+    cursor.readSpace();
+
+    _plid = cursor.readPlid();
+    cursor.readSpace();
 
-    _plid = readPlid(message);
-    readSpace(message);
+    _time = cursor.readTime();
+    cursor.readDelimiter();
 
-    _time = readTime(message);
-    readDelimiter(message);
+    checkDecoded(cursor);
 }
 
-std::string StartCommunication::encodeResponse()
+void StartCommunication::encodeResponse(std::string &message)
 {
-    std::string message;
+    message.clear();
 
     writeString(message, "RSG"); // write identifier "RSG"
     writeSpace(message);
     writeString(message, _status);
 
     writeDelimiter(message); // delimiter at the end
-
-    return message;
 }
 
-void StartCommunication::decodeResponse(MessageSource &message)
+void StartCommunication::decodeResponse(std::string_view message)
 {
+    MessageCursor cursor(message);
 
-    readIdentifier(message, "RSG"); // read identifier "RSG"
-    readSpace(message);
+    cursor.readIdentifier("RSG"); // read identifier "RSG"
+    cursor.readSpace();
 
     // Read the status, and check if it is one of the options
-    _status = readString(message, {"OK", "NOK", "ERR"});
+    _status = cursor.readString({"OK", "NOK", "ERR"});
+
+    cursor.readDelimiter(); // Read the delimiter
 
-    readDelimiter(message); // Read the delimiter
+    checkDecoded(cursor);
 }
 
-std::string TryCommunication::encodeRequest()
+void TryCommunication::encodeRequest(std::string &message)
 {
-    std::string message;
+    message.clear();
 
     writeString(message, "TRY"); // write identifier "TRY"
     writeSpace(message);
@@ -293,28 +142,31 @@ std::string TryCommunication::encodeRequest()
     writeSpace(message);
     writeInt(message, _nT);
     writeDelimiter(message); // delimiter at the end
-
-    return message;
 }
 
-void TryCommunication::decodeRequest(MessageSource &message)
+void TryCommunication::decodeRequest(std::string_view message)
 {
-    readIdentifier(message, "TRY");
-    readSpace(message);
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("TRY");
+    cursor.readSpace();
+
+    _plid = cursor.readPlid();
+    cursor.readSpace();
 
-    _plid = readPlid(message);
-    readSpace(message);
+    _key = cursor.readKey();
+    cursor.readSpace();
 
-    _key = readKey(message);
-    readSpace(message);
+    _nT = cursor.readInt();
+    cursor.readDelimiter();
 
-    _nT = readInt(message);
-    readDelimiter(message);
+    checkDecoded(cursor);
 }
 
-std::string TryCommunication::encodeResponse()
+void TryCommunication::encodeResponse(std::string &message)
 {
-    std::string message;
+    message.clear();
+
     writeString(message, "RTR"); // write identifier "RTR"
     writeSpace(message);
     writeString(message, _status);
@@ -335,51 +187,51 @@ std::string TryCommunication::encodeResponse()
         // if key doesnt have spaces
     }
     writeDelimiter(message); // delimiter at the end
-
-    return message;
 }
 
-void TryCommunication::decodeResponse(MessageSource &message)
+void TryCommunication::decodeResponse(std::string_view message)
 {
-    readIdentifier(message, "RTR"); // read identifier "RSG"
-    readSpace(message);
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("RTR"); // read identifier "RTR"
+    cursor.readSpace();
 
     // Read the status, and check if it is one of the options
-    _status = readString(message, {"OK", "DUP", "INV", "NOK", "ENT", "ETM", "ERR"});
+    _status = cursor.readString({"OK", "DUP", "INV", "NOK", "ENT", "ETM", "ERR"});
 
     if (_status == "OK")
     {
-        readSpace(message);
-        _nT = readInt(message);
-        readSpace(message);
-        _nB = readInt(message);
-        readSpace(message);
-        _nW = readInt(message);
+        cursor.readSpace();
+        _nT = cursor.readInt();
+        cursor.readSpace();
+        _nB = cursor.readInt();
+        cursor.readSpace();
+        _nW = cursor.readInt();
     }
     if (_status == "ENT" || _status == "ETM")
     {
-        readSpace(message);
-        _key = readKey(message);
+        cursor.readSpace();
+        _key = cursor.readKey();
     }
 
-    readDelimiter(message); // Read the delimiter
+    cursor.readDelimiter(); // Read the delimiter
+
+    checkDecoded(cursor);
 }
 
-std::string QuitCommunication::encodeRequest()
+void QuitCommunication::encodeRequest(std::string &message)
 {
-    std::string message;
+    message.clear();
 
     writeString(message, "QUT"); // write identifier "QUT"
     writeSpace(message);
     writeInt(message, _plid);
     writeDelimiter(message); // delimiter at the end
-
-    return message;
 }
 
-std::string QuitCommunication::encodeResponse()
+void QuitCommunication::encodeResponse(std::string &message)
 {
-    std::string message;
+    message.clear();
 
     writeString(message, "RQT"); // write identifier "RQT"
     writeSpace(message);
@@ -390,40 +242,46 @@ std::string QuitCommunication::encodeResponse()
         writeString(message, _key);
     }
     writeDelimiter(message); // delimiter at the end
-
-    return message;
 }
 
-void QuitCommunication::decodeRequest(MessageSource &message)
+void QuitCommunication::decodeRequest(std::string_view message)
 {
-    readIdentifier(message, "QUT");
-    readSpace(message);
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("QUT");
+    cursor.readSpace();
 
-    _plid = readPlid(message);
-    readDelimiter(message);
+    _plid = cursor.readPlid();
+    cursor.readDelimiter();
+
+    checkDecoded(cursor);
 }
 
-void QuitCommunication::decodeResponse(MessageSource &message)
+void QuitCommunication::decodeResponse(std::string_view message)
 {
-    readIdentifier(message, "RQT"); // read identifier "RQT"
-    readSpace(message);
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("RQT"); // read identifier "RQT"
+    cursor.readSpace();
 
     // Read the status, and check if it is one of the options
-    _status = readString(message, {"OK", "NOK", "ERR"});
+    _status = cursor.readString({"OK", "NOK", "ERR"});
 
     if (_status == "OK")
     {
         // read the rest of the string
-        readSpace(message);
-        _key = readKey(message);
+        cursor.readSpace();
+        _key = cursor.readKey();
     }
 
-    readDelimiter(message); // Read the delimiter
+    cursor.readDelimiter(); // Read the delimiter
+
+    checkDecoded(cursor);
 }
 
-std::string DebugCommunication::encodeRequest()
+void DebugCommunication::encodeRequest(std::string &message)
 {
-    std::string message;
+    message.clear();
 
     writeString(message, "DBG"); // write identifier "DBG"
     writeSpace(message);
@@ -433,80 +291,88 @@ std::string DebugCommunication::encodeRequest()
     writeSpace(message);
     writeString(message, _key);
     writeDelimiter(message); // delimiter at the end
-
-    return message;
 }
 
-void DebugCommunication::decodeRequest(MessageSource &message)
+void DebugCommunication::decodeRequest(std::string_view message)
 {
-    readIdentifier(message, "DBG");
-    readSpace(message);
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("DBG");
+    cursor.readSpace();
+
+    _plid = cursor.readPlid();
+    cursor.readSpace();
 
-    _plid = readPlid(message);
-    readSpace(message);
+    _time = cursor.readInt();
+    cursor.readSpace();
 
-    _time = readInt(message);
-    readSpace(message);
+    _key = cursor.readKey();
+    cursor.readDelimiter();
 
-    _key = readKey(message);
-    readDelimiter(message);
+    checkDecoded(cursor);
 }
 
-std::string DebugCommunication::encodeResponse()
+void DebugCommunication::encodeResponse(std::string &message)
 {
-    std::string message;
+    message.clear();
+
     writeString(message, "RDB"); // write identifier "RDB"
     writeSpace(message);
     writeString(message, _status);
 
     writeDelimiter(message); // delimiter at the end
-
-    return message;
 }
 
-void DebugCommunication::decodeResponse(MessageSource &message)
+void DebugCommunication::decodeResponse(std::string_view message)
 {
-    readIdentifier(message, "RDB"); // read identifier "RDB"
-    readSpace(message);
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("RDB"); // read identifier "RDB"
+    cursor.readSpace();
 
     // Read the status, and check if it is one of the options
-    _status = readString(message, {"OK", "NOK", "ERR"});
+    _status = cursor.readString({"OK", "NOK", "ERR"});
 
-    readDelimiter(message); // Read the delimiter
+    cursor.readDelimiter(); // Read the delimiter
+
+    checkDecoded(cursor);
 }
 
-std::string ShowTrialsCommunication::encodeRequest()
+void ShowTrialsCommunication::encodeRequest(std::string &message)
 {
-    std::string message;
+    message.clear();
 
     writeString(message, "STR"); // write identifier "STR"
     writeSpace(message);
     writeInt(message, _plid);
     writeDelimiter(message); // delimiter at the end
-
-    return message;
 }
 
-void ShowTrialsCommunication::decodeRequest(MessageSource &message)
+void ShowTrialsCommunication::decodeRequest(std::string_view message)
 {
-    readIdentifier(message, "STR");
-    readSpace(message);
+    MessageCursor cursor(message);
 
-    _plid = readPlid(message);
+    cursor.readIdentifier("STR");
+    cursor.readSpace();
 
-    readDelimiter(message);
+    _plid = cursor.readPlid();
+
+    cursor.readDelimiter();
+
+    checkDecoded(cursor);
 }
 
-std::string ShowTrialsCommunication::encodeResponse()
+void ShowTrialsCommunication::encodeResponse(std::string &message)
 {
-    std::string message;
+    message.clear();
+
     writeString(message, "RST"); // write identifier "RST"
     writeSpace(message);
     writeString(message, _status);
 
     if (_status == "ACT" || _status == "FIN")
     { // with ongoing game or no ongoing game for player
-        if (_Fsize > MAX_FSIZE)
+        if (_Fsize > (_FdataFollows ? MAX_STREAM_FSIZE : MAX_FSIZE))
         {
             throw ProtocolViolationException();
         }
@@ -518,74 +384,71 @@ std::string ShowTrialsCommunication::encodeResponse()
         writeInt(message, _Fsize);
         writeSpace(message);
 
-        for (int i = 0; i < _Fsize; i++)
-        {
-            char c = readChar(_Fdata, (size_t)i);
-            writeChar(message, c);
-        }
+        if (_FdataFollows)
+            return; // the sender appends the file and the delimiter
+        writeFile(message, _Fdata, _Fsize);
     }
     writeDelimiter(message); // delimiter at the end
-
-    return message;
 }
 
-void ShowTrialsCommunication::decodeResponse(MessageSource &message)
+void ShowTrialsCommunication::decodeResponse(std::string_view message)
 {
-    readIdentifier(message, "RST"); // read identifier "RST"
-    readSpace(message);
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("RST"); // read identifier "RST"
+    cursor.readSpace();
 
     // Read the status, and check if it is one of the options
-    _status = readString(message, {"ACT", "FIN", "NOK"});
+    _status = cursor.readString({"ACT", "FIN", "NOK"});
 
     if (_status == "ACT" || _status == "FIN")
     { // with ongoing game or no ongoing game for player
-        readSpace(message);
-        _Fname = readString(message);
-        readSpace(message);
-        _Fsize = readInt(message);
+        cursor.readSpace();
+        _Fname = cursor.readString(MAX_FNAME);
+        cursor.readSpace();
+        _Fsize = cursor.readInt();
 
-        if (_Fsize > MAX_FSIZE)
-        {
-            throw ProtocolViolationException();
-        }
-        readSpace(message);
+        if (_Fsize > MAX_STREAM_FSIZE)
+            cursor.fail();
+        cursor.readSpace();
 
-        for (int i = 0; i < _Fsize; i++)
-        {
-            char c = readChar(message);
-            writeChar(_Fdata, c);
-        }
+        _Fdata = cursor.readBytes((size_t)_Fsize);
     }
 
-    readDelimiter(message); // Read the delimiter
+    cursor.readDelimiter(); // Read the delimiter
+
+    checkDecoded(cursor);
 }
 
-std::string ScoreboardCommunication::encodeRequest()
+void ScoreboardCommunication::encodeRequest(std::string &message)
 {
-    std::string message;
+    message.clear();
 
     writeString(message, "SSB"); // write identifier "SSB"
     writeDelimiter(message);     // delimiter at the end
-
-    return message;
 }
 
-void ScoreboardCommunication::decodeRequest(MessageSource &message)
+void ScoreboardCommunication::decodeRequest(std::string_view message)
 {
-    readIdentifier(message, "SSB");
-    readDelimiter(message);
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("SSB");
+    cursor.readDelimiter();
+
+    checkDecoded(cursor);
 }
 
-std::string ScoreboardCommunication::encodeResponse()
+void ScoreboardCommunication::encodeResponse(std::string &message)
 {
-    std::string message;
+    message.clear();
+
     writeString(message, "RSS"); // write identifier "RSS"
     writeSpace(message);
     writeString(message, _status);
 
     if (_status == "OK")
     {
-        if (_Fsize > MAX_FSIZE)
+        if (_Fsize > (_FdataFollows ? MAX_STREAM_FSIZE : MAX_FSIZE))
         {
             throw ProtocolViolationException();
         }
@@ -597,44 +460,80 @@ std::string ScoreboardCommunication::encodeResponse()
         writeInt(message, _Fsize);
         writeSpace(message);
 
-        for (int i = 0; i < _Fsize; i++)
-        {
-            char c = readChar(_Fdata, (size_t)i);
-            writeChar(message, c);
-        }
+        if (_FdataFollows)
+            return; // the sender appends the file and the delimiter
+        writeFile(message, _Fdata, _Fsize);
     }
     writeDelimiter(message); // delimiter at the end
-
-    return message;
 }
 
-void ScoreboardCommunication::decodeResponse(MessageSource &message)
+void ScoreboardCommunication::decodeResponse(std::string_view message)
 {
-    readIdentifier(message, "RSS"); // read identifier "RSS"
-    readSpace(message);
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("RSS"); // read identifier "RSS"
+    cursor.readSpace();
 
     // Read the status, and check if it is one of the options
-    _status = readString(message, std::vector<std::string>{"EMPTY", "OK"});
+    _status = cursor.readString({"EMPTY", "OK"});
 
     if (_status == "OK")
     {
-        readSpace(message);
-        _Fname = readString(message);
-        readSpace(message);
-        _Fsize = readInt(message);
+        cursor.readSpace();
+        _Fname = cursor.readString(MAX_FNAME);
+        cursor.readSpace();
+        _Fsize = cursor.readInt();
 
-        if (_Fsize > MAX_FSIZE)
-        {
-            throw ProtocolViolationException();
-        }
-        readSpace(message);
+        if (_Fsize > MAX_STREAM_FSIZE)
+            cursor.fail();
+        cursor.readSpace();
 
-        for (int i = 0; i < _Fsize; i++)
-        {
-            char c = readChar(message);
-            writeChar(_Fdata, c);
-        }
+        _Fdata = cursor.readBytes((size_t)_Fsize);
     }
 
-    readDelimiter(message); // Read the delimiter
-}
\ No newline at end of file
+    cursor.readDelimiter(); // Read the delimiter
+
+    checkDecoded(cursor);
+}
+
+void KeepAliveCommunication::encodeRequest(std::string &message)
+{
+    message.clear();
+
+    writeString(message, "KAL"); // write identifier "KAL"
+    writeDelimiter(message);     // delimiter at the end
+}
+
+void KeepAliveCommunication::decodeRequest(std::string_view message)
+{
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("KAL");
+    cursor.readDelimiter();
+
+    checkDecoded(cursor);
+}
+
+void KeepAliveCommunication::encodeResponse(std::string &message)
+{
+    message.clear();
+
+    writeString(message, "RKA"); // write identifier "RKA"
+    writeSpace(message);
+    writeString(message, _status);
+    writeDelimiter(message); // delimiter at the end
+}
+
+void KeepAliveCommunication::decodeResponse(std::string_view message)
+{
+    MessageCursor cursor(message);
+
+    cursor.readIdentifier("RKA"); // read identifier "RKA"
+    cursor.readSpace();
+
+    _status = cursor.readString({"OK"});
+
+    cursor.readDelimiter(); // Read the delimiter
+
+    checkDecoded(cursor);
+}
@@ -2,6 +2,7 @@
 #define PROTOCOL_HPP
 
 #include <unistd.h>
+#include <charconv>
 #include <ctime>
 #include <deque>
 #include <iomanip>
@@ -9,6 +10,7 @@
 #include <map>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "utils.hpp"
@@ -42,188 +44,261 @@ class ProtocolMessageErrorException : public ProtocolException
 };
 
 /**
- * @brief The MessageSource class represents a source of messages.
+ * @brief Packs the three characters of a message identifier into an integer.
  *
- * This class provides an interface for retrieving characters from a message
- * source. Subclasses of MessageSource must implement the get(), good(), and
- * unget() methods.
+ * Being constexpr, it can also be used for the case labels of a switch.
  */
-class MessageSource
+constexpr uint32_t packOpcode(const char *identifier)
 {
-public:
-  /**
-   * @brief Get the next character from the message source.
-   *
-   * @return The next character from the message source.
-   */
-  virtual char get() = 0;
+  return (uint32_t)(unsigned char)identifier[0] << 16 |
+         (uint32_t)(unsigned char)identifier[1] << 8 |
+         (uint32_t)(unsigned char)identifier[2];
+}
 
-  /**
-   * @brief Check if the message source is in a good state.
-   *
-   * @return true if the message source is in a good state, false otherwise.
-   */
-  virtual bool good() = 0;
-
-  /**
-   * @brief Unget the last character read from the message source.
-   *
-   * This method allows the caller to "unread" the last character read from
-   * the message source. After calling unget(), the next call to get() should
-   * return the same character that was previously read.
-   */
-  virtual void unget() = 0;
-};
+/**
+ * @brief Reads the PLID of a request ("XXX PLID ..."), if it has one,
+ * without decoding the rest of it.
+ * @return The PLID, or -1.
+ */
+int requestPlid(std::string_view request);
 
 /**
- * @brief Represents a message source that reads from a string.
+ * @brief A cursor over a received message.
+ *
+ * The fields are parsed in place from the message, without copying it,
+ * allocating or throwing. The first malformed field puts the cursor in a
+ * failed state, where every following read fails too, so a decoder only
+ * has to check good() once, after reading the whole message.
  */
-class StreamMessage : public MessageSource
+class MessageCursor
 {
 private:
-  std::string &_stream;
-  size_t _current_pos; // current index
+  std::string_view _message;
+  size_t _pos;        // current index
+  bool _failed;       // whether a read failed
+  bool _errorMessage; // whether the message was the error identifier
 
-public:
   /**
-   * @brief Constructs a StreamMessage object with the given string.
-   *
-   * @param stream The string to read from.
+   * @brief Checks if a character ends a field.
    */
-  StreamMessage(std::string &stream) : _stream(stream), _current_pos(0) {};
+  static bool isSeparator(char c) { return c == ' ' || c == '\n'; };
 
+public:
   /**
-   * @brief Reads the next character from the string.
-   *
-   * @return The next character from the string.
+   * @brief Maximum digits of a number, so that it always fits in an int.
    */
-  char get()
-  {
-    if (_current_pos < _stream.size())
-      return _stream[_current_pos++];
-    throw std::out_of_range("End of stream reached");
-  };
+  static const size_t MAX_INT_DIGITS = 9;
 
   /**
-   * @brief Checks if the string is in a good state.
+   * @brief Constructs a cursor at the start of the message.
    *
-   * @return True if the string is in a good state, false otherwise.
+   * @param message The message to read from, which must outlive the cursor.
    */
-  bool good() { return _current_pos < _stream.size(); };
+  MessageCursor(std::string_view message)
+      : _message(message), _pos(0), _failed(false), _errorMessage(false) {};
 
   /**
-   * @brief Puts the last character extracted from the string back.
+   * @brief Checks if every read so far succeeded.
    */
-  void unget()
-  {
-    if (_current_pos > 0)
-      --_current_pos;
-  };
-};
-
-
-/**
- * @brief The ProtocolCommunication class is an abstract base class that defines
- * the interface for communication protocols.
- */
-class ProtocolCommunication
-{
-public:
-  // Each subclass should implement their information as members.
-
-  virtual std::string encodeRequest() = 0;
-
-  virtual void decodeRequest(MessageSource &message) = 0;
-
-  virtual std::string encodeResponse() = 0;
-
-  virtual void decodeResponse(MessageSource &message) = 0;
-
-  // General purpose methods to allow parsing and encoding.
+  bool good() const { return !_failed; };
 
   /**
-   * @brief Reads character from position pos from a string.
+   * @brief Checks if the message was the error identifier (ERR).
    */
-  char readChar(std::string &message, size_t pos);
+  bool isErrorMessage() const { return _errorMessage; };
 
   /**
-   * @brief Reads a character from a MessageSource.
+   * @brief Puts the cursor in the failed state.
    */
-  char readChar(MessageSource &message);
+  void fail() { _failed = true; };
 
   /**
-   * @brief Reads a character from a MessageSource.
+   * @brief Reads the given character.
    */
-  void readChar(MessageSource &message, char expected);
+  void readChar(char expected)
+  {
+    if (_failed || _pos >= _message.size() || _message[_pos] != expected)
+      _failed = true;
+    else
+      _pos++;
+  };
 
   /**
-   * @brief Reads a character from a MessageSource.
+   * @brief Reads a delimiter.
    */
-  char readChar(MessageSource &message, std::vector<char> options);
+  void readDelimiter() { readChar('\n'); };
 
   /**
-   * @brief Reads a delimiter from a MessageSource.
+   * @brief Reads a space.
    */
-  void readDelimiter(MessageSource &message);
+  void readSpace() { readChar(' '); };
 
   /**
-   * @brief Reads a space from a MessageSource.
+   * @brief Reads a field of at most n characters, up to a space or delimiter.
+   *
+   * @return The field, as a view into the message.
    */
-  void readSpace(MessageSource &message);
+  std::string_view readString(size_t n = std::string_view::npos)
+  {
+    if (_failed)
+      return std::string_view();
 
-  /**
-   * @brief Reads a string from a MessageSource.
-   */
-  std::string readString(MessageSource &message);
+    size_t start = _pos;
+    while (_pos < _message.size() && _pos - start < n && !isSeparator(_message[_pos]))
+      _pos++;
+    return _message.substr(start, _pos - start);
+  };
 
   /**
-   * @brief Reads a string from a MessageSource.
+   * @brief Reads a field that must be one of the options.
+   *
+   * @return The field, as a view into the message.
    */
-  std::string readString(MessageSource &message, size_t n);
+  std::string_view readString(std::initializer_list<std::string_view> options)
+  {
+    std::string_view field = readString();
+    for (std::string_view option : options)
+    {
+      if (field == option)
+        return field;
+    }
+    _failed = true;
+    return std::string_view();
+  };
 
   /**
-   * @brief Reads a string from a MessageSource.
+   * @brief Reads a non-negative number of at most maxDigits digits.
+   *
+   * @return The number, or 0 if it is malformed.
    */
-  void readString(MessageSource &message, std::string expected);
+  int readInt(size_t maxDigits = MAX_INT_DIGITS)
+  {
+    if (maxDigits > MAX_INT_DIGITS)
+      maxDigits = MAX_INT_DIGITS;
+
+    std::string_view digits = readString(maxDigits);
+    if (digits.empty())
+      _failed = true;
+
+    int value = 0;
+    for (char c : digits)
+    {
+      if (c < '0' || c > '9')
+      {
+        _failed = true;
+        return 0;
+      }
+      value = value * 10 + (c - '0');
+    }
+    return _failed ? 0 : value;
+  };
 
   /**
-   * @brief Reads a string from a MessageSource.
+   * @brief Reads a PLID.
    */
-  std::string readString(MessageSource &message,
-                         std::vector<std::string> options);
+  int readPlid() { return readInt(PLID_MAX_SIZE); };
 
   /**
-   * @brief Reads a number from a MessageSource.
+   * @brief Reads a game time.
    */
-  int readInt(MessageSource &message);
+  int readTime() { return readInt(MAX_PLAYTIME_DIGITS); };
 
   /**
-   * @brief Reads an int from a MessageSource with the specified size.
+   * @brief Reads a key of four colors separated by spaces, "C C C C".
+   *
+   * @return The key, as a view into the message.
    */
-  int readInt(MessageSource &message, size_t size);
+  std::string_view readKey()
+  {
+    static const std::string_view colors = "RGBYOP";
+    const size_t length = 2 * KEY_SIZE - 1;
+
+    if (_failed || _message.size() - _pos < length)
+    {
+      _failed = true;
+      return std::string_view();
+    }
+
+    std::string_view key = _message.substr(_pos, length);
+    for (size_t i = 0; i < length; i++)
+    {
+      bool valid = i % 2 ? key[i] == ' ' : colors.find(key[i]) != std::string_view::npos;
+      if (!valid)
+      {
+        _failed = true;
+        return std::string_view();
+      }
+    }
+    _pos += length;
+    return key;
+  };
 
   /**
-   * @brief Reads a PLID from a MessageSource.
+   * @brief Reads exactly n bytes, whatever they are.
+   *
+   * @return The bytes, as a view into the message.
    */
-  int readPlid(MessageSource &message);
+  std::string_view readBytes(size_t n)
+  {
+    if (_failed || _message.size() - _pos < n)
+    {
+      _failed = true;
+      return std::string_view();
+    }
+    std::string_view bytes = _message.substr(_pos, n);
+    _pos += n;
+    return bytes;
+  };
 
   /**
-   * @brief Reads time from a MessageSource.
+   * @brief Reads the identifier of a message.
+   *
+   * Reading the error identifier (ERR) instead also fails, and is reported
+   * by isErrorMessage().
    */
-  int readTime(MessageSource &message);
+  void readIdentifier(std::string_view identifier)
+  {
+    std::string_view received = readString(3);
+    if (received == PROTOCOL_ERROR)
+    {
+      _errorMessage = true;
+      _failed = true;
+    }
+    else if (received != identifier)
+      _failed = true;
+  };
+};
 
-  /**
-   * @brief Reads key from a MessageSource.
-   */
-  std::string readKey(MessageSource &message);
+/**
+ * @brief The ProtocolCommunication class is an abstract base class that defines
+ * the interface for communication protocols.
+ */
+class ProtocolCommunication
+{
+public:
+  // Each subclass should implement their information as members.
+
+  // The encoders replace the content of message, keeping its capacity, so
+  // a buffer reused across messages stops allocating once it is big enough.
+
+  virtual void encodeRequest(std::string &message) = 0;
+
+  virtual void decodeRequest(std::string_view message) = 0;
+
+  virtual void encodeResponse(std::string &message) = 0;
+
+  virtual void decodeResponse(std::string_view message) = 0;
+
+  // General purpose methods to allow parsing and encoding.
 
   /**
-   * @brief Reads a identifier from a MessageSource.
+   * @brief Checks that a message was fully decoded.
    *
-   * @param message The MessageSource to read from.
-   * @param identifier The identifier to read.
+   * @param cursor The cursor that read the message.
+   * @throws ProtocolMessageErrorException if the message was ERR.
+   * @throws ProtocolViolationException if the message was malformed.
    */
-  void readIdentifier(MessageSource &message, std::string identifier);
+  void checkDecoded(MessageCursor &cursor);
 
   /**
    * @brief Writes a character to string.
@@ -253,7 +328,7 @@ public:
    * @param message The string to write to.
    * @param string The string to write.
    */
-  void writeString(std::string &message, std::string string);
+  void writeString(std::string &message, std::string_view string);
 
   /**
    * @brief Writes an int to string.
@@ -269,7 +344,16 @@ public:
    * @param message The message to write the file name to.
    * @param fileName The name of the file to be written.
    */
-  void writeFileName(std::string &message, std::string fileName);
+  void writeFileName(std::string &message, std::string_view fileName);
+
+  /**
+   * @brief Writes the first size bytes of a file to the given message.
+   *
+   * @param message The message to write the file to.
+   * @param data The contents of the file.
+   * @param size The size of the file, in bytes.
+   */
+  void writeFile(std::string &message, std::string_view data, int size);
 
   /**
    * @brief Checks if the communication protocol uses TCP.
@@ -295,13 +379,13 @@ public:
   // Response parameters:
   std::string _status; // The status of the start response.
 
-  std::string encodeRequest();
+  void encodeRequest(std::string &message);
 
-  void decodeRequest(MessageSource &message);
+  void decodeRequest(std::string_view message);
 
-  std::string encodeResponse();
+  void encodeResponse(std::string &message);
 
-  void decodeResponse(MessageSource &message);
+  void decodeResponse(std::string_view message);
 
   bool isTcp() { return false; };
 };
@@ -319,13 +403,13 @@ public:
   int _nB;
   int _nW;
 
-  std::string encodeRequest();
+  void encodeRequest(std::string &message);
 
-  void decodeRequest(MessageSource &message);
+  void decodeRequest(std::string_view message);
 
-  std::string encodeResponse();
+  void encodeResponse(std::string &message);
 
-  void decodeResponse(MessageSource &message);
+  void decodeResponse(std::string_view message);
 
   bool isTcp() { return false; };
 };
@@ -340,13 +424,13 @@ class QuitCommunication : public ProtocolCommunication
   std::string _status; // The status of the quit response.
   std::string _key;
 
-  std::string encodeRequest();
+  void encodeRequest(std::string &message);
 
-  void decodeRequest(MessageSource &message);
+  void decodeRequest(std::string_view message);
 
-  std::string encodeResponse();
+  void encodeResponse(std::string &message);
 
-  void decodeResponse(MessageSource &message);
+  void decodeResponse(std::string_view message);
 
   bool isTcp() { return false; } 
 };
@@ -362,13 +446,13 @@ class DebugCommunication : public ProtocolCommunication {
     // Response parameters:
     std::string _status;
 
-  std::string encodeRequest();
+  void encodeRequest(std::string &message);
 
-  void decodeRequest(MessageSource &message);
+  void decodeRequest(std::string_view message);
 
-  std::string encodeResponse();
+  void encodeResponse(std::string &message);
 
-  void decodeResponse(MessageSource &message);
+  void decodeResponse(std::string_view message);
 
   bool isTcp() { return false; };
 };
@@ -385,14 +469,15 @@ class ShowTrialsCommunication : public ProtocolCommunication {
     std::string _Fname;     // The filename
     int _Fsize;             // The file size, in bytes
     std::string _Fdata;     // Thecontents of the selected file.
+    bool _FdataFollows = false; // Fdata and the delimiter are sent after the encoded response, from a file
 
-    std::string encodeRequest();
+    void encodeRequest(std::string &message);
 
-    void decodeRequest(MessageSource &message);
+    void decodeRequest(std::string_view message);
 
-    std::string encodeResponse();
+    void encodeResponse(std::string &message);
 
-    void decodeResponse(MessageSource &message);
+    void decodeResponse(std::string_view message);
 
     bool isTcp() { return true; };
 };
@@ -406,14 +491,40 @@ class ScoreboardCommunication : public ProtocolCommunication {
     std::string _Fname;     // The filename
     int _Fsize;             // The file size, in bytes
     std::string _Fdata;     // Thecontents of the selected file.
+    bool _FdataFollows = false; // Fdata and the delimiter are sent after the encoded response, from a file
+
+    void encodeRequest(std::string &message);
+
+    void decodeRequest(std::string_view message);
+
+    void encodeResponse(std::string &message);
+
+    void decodeResponse(std::string_view message);
+
+    bool isTcp() { return true; };
+};
+
+
+/**
+ * @brief Asks to keep a TCP connection open for more requests ("KAL").
+ *
+ * After the "RKA OK" response, the server answers every request on the
+ * connection, in order, and precedes each response with its size in bytes
+ * and a delimiter, so the client can tell where it ends without waiting
+ * for the connection to close. Requests may be pipelined.
+ */
+class KeepAliveCommunication : public ProtocolCommunication {
+  public:
+    // Response parameters:
+    std::string _status;    // The status of the keep-alive response.
 
-    std::string encodeRequest();
+    void encodeRequest(std::string &message);
 
-    void decodeRequest(MessageSource &message);
+    void decodeRequest(std::string_view message);
 
-    std::string encodeResponse();
+    void encodeResponse(std::string &message);
 
-    void decodeResponse(MessageSource &message);
+    void decodeResponse(std::string_view message);
 
     bool isTcp() { return true; };
 };
@@ -0,0 +1,183 @@
+#include "scoring.hpp"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const char COLORS[KEY_COLORS + 1] = "RGBYOP";
+
+static int colorIndex(char color)
+{
+    switch (color)
+    {
+    case 'R':
+        return 0;
+    case 'G':
+        return 1;
+    case 'B':
+        return 2;
+    case 'Y':
+        return 3;
+    case 'O':
+        return 4;
+    case 'P':
+        return 5;
+    default:
+        return -1;
+    }
+}
+
+/**
+ * @brief Gets the color index of each peg of a code.
+ */
+static void unpackPegs(int code, int pegs[KEY_SIZE])
+{
+    for (int i = KEY_SIZE - 1; i >= 0; i--)
+    {
+        pegs[i] = code % KEY_COLORS;
+        code /= KEY_COLORS;
+    }
+}
+
+static std::vector<uint8_t> buildScoreTable()
+{
+    std::vector<uint8_t> table((size_t)KEY_CODES * KEY_CODES);
+
+    for (int guess = 0; guess < KEY_CODES; guess++)
+    {
+        int guessPegs[KEY_SIZE];
+        unpackPegs(guess, guessPegs);
+
+        for (int secret = 0; secret < KEY_CODES; secret++)
+        {
+            int secretPegs[KEY_SIZE];
+            unpackPegs(secret, secretPegs);
+
+            int black = 0;
+            int guessCount[KEY_COLORS] = {0}, secretCount[KEY_COLORS] = {0};
+            for (int i = 0; i < KEY_SIZE; i++)
+            {
+                if (guessPegs[i] == secretPegs[i])
+                    black++;
+                guessCount[guessPegs[i]]++;
+                secretCount[secretPegs[i]]++;
+            }
+
+            // every color in common is a peg, and the ones in place are black
+            int matches = 0;
+            for (int c = 0; c < KEY_COLORS; c++)
+                matches += std::min(guessCount[c], secretCount[c]);
+
+            table[(size_t)guess * KEY_CODES + (size_t)secret] =
+                (uint8_t)(black << 4 | (matches - black));
+        }
+    }
+    return table;
+}
+
+int packKey(const std::string &key)
+{
+    if (key.size() != KEY_SIZE)
+        return -1;
+
+    int code = 0;
+    for (char c : key)
+    {
+        int color = colorIndex(c);
+        if (color == -1)
+            return -1;
+        code = code * KEY_COLORS + color;
+    }
+    return code;
+}
+
+std::string unpackKey(int code)
+{
+    int pegs[KEY_SIZE];
+    unpackPegs(code, pegs);
+
+    std::string key;
+    for (int peg : pegs)
+        key += COLORS[peg];
+    return key;
+}
+
+uint8_t scoreCodes(int guess, int secret)
+{
+    // built once, on first use (thread-safe static initialization)
+    static const std::vector<uint8_t> table = buildScoreTable();
+
+    return table[(size_t)guess * KEY_CODES + (size_t)secret];
+}
+
+void SecretSet::add(int code)
+{
+    int pegs[KEY_SIZE];
+    unpackPegs(code, pegs);
+
+    for (int i = 0; i < KEY_SIZE; i++)
+        _pegs[i].push_back((uint8_t)pegs[i]);
+}
+
+size_t SecretSet::size() const
+{
+    return _pegs[0].size();
+}
+
+void scoreMany(int guess, const SecretSet &secrets, uint8_t *blacks, uint8_t *whites)
+{
+    int guessPegs[KEY_SIZE];
+    unpackPegs(guess, guessPegs);
+
+    size_t n = secrets.size();
+    size_t i = 0;
+
+#ifdef __SSE2__
+    int guessCount[KEY_COLORS] = {0};
+    for (int peg : guessPegs)
+        guessCount[peg]++;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i pegs[KEY_SIZE];
+        for (int p = 0; p < KEY_SIZE; p++)
+            pegs[p] = _mm_loadu_si128((const __m128i *)(secrets._pegs[p].data() + i));
+
+        // a comparison yields -1 per matching lane, so subtracting counts it
+        __m128i black = _mm_setzero_si128();
+        for (int p = 0; p < KEY_SIZE; p++)
+            black = _mm_sub_epi8(black, _mm_cmpeq_epi8(pegs[p], _mm_set1_epi8((char)guessPegs[p])));
+
+        __m128i matches = _mm_setzero_si128();
+        for (int c = 0; c < KEY_COLORS; c++)
+        {
+            if (guessCount[c] == 0)
+                continue;
+
+            __m128i color = _mm_set1_epi8((char)c);
+            __m128i count = _mm_setzero_si128();
+            for (int p = 0; p < KEY_SIZE; p++)
+                count = _mm_sub_epi8(count, _mm_cmpeq_epi8(pegs[p], color));
+
+            matches = _mm_add_epi8(matches, _mm_min_epu8(count, _mm_set1_epi8((char)guessCount[c])));
+        }
+
+        _mm_storeu_si128((__m128i *)(blacks + i), black);
+        _mm_storeu_si128((__m128i *)(whites + i), _mm_sub_epi8(matches, black));
+    }
+#endif
+
+    // the remaining secrets (or all of them, without SSE2) use the table
+    for (; i < n; i++)
+    {
+        int secret = 0;
+        for (int p = 0; p < KEY_SIZE; p++)
+            secret = secret * KEY_COLORS + secrets._pegs[p][i];
+
+        uint8_t score = scoreCodes(guess, secret);
+        blacks[i] = (uint8_t)scoreBlack(score);
+        whites[i] = (uint8_t)scoreWhite(score);
+    }
+}
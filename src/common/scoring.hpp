@@ -0,0 +1,68 @@
+#ifndef SCORING_H
+#define SCORING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constants.hpp"
+
+/**
+ * @brief Packs a key "CCCC" into its code, a number in [0, KEY_CODES).
+ *
+ * Each peg is a base-KEY_COLORS digit, the first peg being the most
+ * significant one, with the colors ordered R G B Y O P.
+ *
+ * @param key The key, without spaces.
+ * @return The code, or -1 if the key is not KEY_SIZE valid colors.
+ */
+int packKey(const std::string &key);
+
+/**
+ * @brief Unpacks a code into its key "CCCC".
+ */
+std::string unpackKey(int code);
+
+/**
+ * @brief Scores a guess against a secret, from the precomputed table.
+ *
+ * The table holds the result of every (guess, secret) pair and is built
+ * the first time it is needed.
+ *
+ * @param guess Code of the guess.
+ * @param secret Code of the secret key.
+ * @return The number of black pegs in the high nibble and of white pegs
+ * in the low nibble.
+ */
+uint8_t scoreCodes(int guess, int secret);
+
+inline int scoreBlack(uint8_t score) { return score >> 4; }
+inline int scoreWhite(uint8_t score) { return score & 0x0F; }
+
+/**
+ * @class SecretSet
+ * @brief Many secret keys, stored peg by peg so they can be scored together.
+ */
+class SecretSet
+{
+public:
+    std::vector<uint8_t> _pegs[KEY_SIZE]; // Color index of each peg, by secret
+
+    void add(int code);
+    size_t size() const;
+};
+
+/**
+ * @brief Scores one guess against every secret of a set.
+ *
+ * Uses SSE2 to score 16 secrets per iteration when available.
+ *
+ * @param guess Code of the guess.
+ * @param secrets The secrets.
+ * @param blacks Receives the number of black pegs of each secret.
+ * @param whites Receives the number of white pegs of each secret.
+ */
+void scoreMany(int guess, const SecretSet &secrets, uint8_t *blacks, uint8_t *whites);
+
+#endif
@@ -1,11 +1,11 @@
 #include "utils.hpp"
 #include "protocol.hpp"
+#include "scoring.hpp"
 
 #include <iostream>
-#include <unordered_map>
 #include <dirent.h>
 
-bool is_exiting = false;
+std::atomic<bool> is_exiting(false);
 
 bool is_numeric(std::string &str)
 {
@@ -153,12 +153,8 @@ std::string generateRandomKey()
     std::vector<std::string> colors = {"R", "G", "B", "Y", "O", "P"};
 
     // Seed the random number generator with the current time (once per program run)
-    static bool seeded = false;
-    if (!seeded)
-    {
-        std::srand((unsigned)std::time(nullptr));
-        seeded = true;
-    }
+    static bool seeded = (std::srand((unsigned)std::time(nullptr)), true);
+    (void)seeded;
 
     for (int i = 0; i < 4; i++)
     {
@@ -175,12 +171,21 @@ int get_playtime(std::string playtime)
 
 std::string currentDateTime()
 {
-    time_t fulltime;
+    return formatDateTime(time(NULL));
+}
+
+std::string currentDateTimeFN()
+{
+    return formatDateTimeFN(time(NULL));
+}
+
+std::string formatDateTime(time_t fulltime)
+{
+    struct tm time_buffer;
     struct tm *current_time;
     char time_str[50];
 
-    time(&fulltime);
-    current_time = gmtime(&fulltime);
+    current_time = gmtime_r(&fulltime, &time_buffer); // gmtime() is not thread-safe
     sprintf(time_str, "%4d-%02d-%02d %02d:%02d:%02d", current_time->tm_year + 1900,
             current_time->tm_mon + 1, current_time->tm_mday,
             current_time->tm_hour, current_time->tm_min, current_time->tm_sec);
@@ -188,14 +193,13 @@ std::string currentDateTime()
     return time_str;
 }
 
-std::string currentDateTimeFN()
+std::string formatDateTimeFN(time_t fulltime)
 {
-    time_t fulltime;
+    struct tm time_buffer;
     struct tm *current_time;
     char time_str[50];
 
-    time(&fulltime);
-    current_time = gmtime(&fulltime);
+    current_time = gmtime_r(&fulltime, &time_buffer); // gmtime() is not thread-safe
     sprintf(time_str, "%4d%02d%02d_%02d%02d%02d", current_time->tm_year + 1900,
             current_time->tm_mon + 1, current_time->tm_mday,
             current_time->tm_hour, current_time->tm_min, current_time->tm_sec);
@@ -252,8 +256,12 @@ std::string gameFileName(std::string PLID)
     return "GAME_" + PLID + ".txt";
 }
 
-int black(const std::string key, const std::string guess)
+int black(const std::string &key, const std::string &guess)
 {
+    int keyCode = packKey(key), guessCode = packKey(guess);
+    if (keyCode != -1 && guessCode != -1)
+        return scoreBlack(scoreCodes(guessCode, keyCode));
+
     int count = 0;
     for (std::string::size_type i = 0; i < key.size(); i++)
     {
@@ -265,40 +273,30 @@ int black(const std::string key, const std::string guess)
     return count;
 }
 
-int white(const std::string key, const std::string guess)
+int white(const std::string &key, const std::string &guess)
 {
+    int keyCode = packKey(key), guessCode = packKey(guess);
+    if (keyCode != -1 && guessCode != -1)
+        return scoreWhite(scoreCodes(guessCode, keyCode));
+
     int whiteCount = 0;
 
     // store counts of colors that are unmatched in correct position
-    std::unordered_map<char, int> secretFreq, guessFreq;
+    int secretFreq[256] = {0}, guessFreq[256] = {0};
 
-    // Loop through to first count the exact matches for black pieces
     for (std::string::size_type i = 0; i < key.size(); i++)
     {
-        if (key[i] == guess[i])
-        {
-            // black piece
-            continue;
-        }
-        else
+        if (key[i] != guess[i])
         {
             // record the unmatched colors
-            secretFreq[key[i]]++;
-            guessFreq[guess[i]]++;
+            secretFreq[(unsigned char)key[i]]++;
+            guessFreq[(unsigned char)guess[i]]++;
         }
     }
 
     // Calculate white pieces by comparing the frequencies
-    for (const auto &entry : guessFreq)
-    {
-        char color = entry.first;
-        int guessCount = entry.second;
-        if (secretFreq.find(color) != secretFreq.end())
-        {
-            // The color exists in the secret, so add the minimum count of that color in guess and secret
-            whiteCount += std::min(guessCount, secretFreq[color]);
-        }
-    }
+    for (int c = 0; c < 256; c++)
+        whiteCount += std::min(guessFreq[c], secretFreq[c]);
 
     return whiteCount;
 }
@@ -372,31 +370,3 @@ int findTopScores(SCORELIST *list)
     // Update the number of scores in the list
     return ifile;
 }
-
-void findLastGame(std::string plid, std::string &pathToLastGame)
-{
-    struct dirent **fileList;
-    int n_entries;
-    bool found = false;
-
-    std::string path = GAMES_DIR + plid;
-
-    n_entries = scandir(path.c_str(), &fileList, 0, alphasort);
-    if (n_entries <= 0)
-    {
-        throw UnrecoverableError("Failed to scan directory: " + path);
-    }
-
-    // Iterate backwards to find the last alphabetical file
-    while (n_entries--)
-    {
-        if (fileList[n_entries]->d_name[0] != '.' && !found)
-        {
-            pathToLastGame = path + "/" + fileList[n_entries]->d_name;
-            found = true;
-        }
-        free(fileList[n_entries]);
-    }
-
-    free(fileList); // Free the entire fileList array
-}
@@ -2,9 +2,11 @@
 #define UTILS_H
 
 #include <cstring>
+#include <ctime>
 #include <stdexcept>
 #include <csignal>
 #include <vector>
+#include <atomic>
 
 #include "constants.hpp"
 
@@ -36,6 +38,8 @@ std::string get_color_key(std::vector<std::string> args);
 
 std::string currentDateTime();
 std::string currentDateTimeFN();
+std::string formatDateTime(time_t time);
+std::string formatDateTimeFN(time_t time);
 std::string truncateDate(std::string datetime);
 
 void setup_signal_handlers();
@@ -45,8 +49,8 @@ std::string generateRandomKey();
 std::string gameFileName(std::string PLID);
 std::string playerDirectory(std::string PLID);
 
-int black(const std::string key, const std::string secretKey);
-int white(const std::string key, const std::string secretKey);
+int black(const std::string &key, const std::string &secretKey);
+int white(const std::string &key, const std::string &secretKey);
 
 typedef struct
 {
@@ -59,6 +63,4 @@ typedef struct
 
 int findTopScores(SCORELIST *list);
 
-void findLastGame(std::string plid, std::string &path);
-
 #endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "admission.hpp"
+#include "../common/protocol.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+AdmissionControl::AdmissionControl() : _ipBuckets(TABLE_SIZE), _plidBuckets(TABLE_SIZE)
+{
+}
+
+void AdmissionControl::setLimits(int ipRate, int plidRate, int queueLimit)
+{
+    _ipRate = ipRate;
+    _plidRate = plidRate;
+    _queueLimit = queueLimit;
+}
+
+bool AdmissionControl::watchesQueue()
+{
+    return _queueLimit > 0;
+}
+
+bool AdmissionControl::take(std::vector<Bucket> &table, uint32_t key, int rate, int64_t now)
+{
+    // Fibonacci hashing spreads consecutive addresses and PLIDs over the table
+    size_t slot = (uint32_t)(key * 2654435761u) >> (32 - ADMISSION_TABLE_BITS);
+    std::lock_guard<std::mutex> guard(_locks[slot % ADMISSION_LOCK_STRIPES]);
+
+    Bucket &bucket = table[slot];
+    double burst = (double)rate * ADMISSION_BURST_SECONDS;
+    if (!bucket._used)
+    {
+        bucket._used = true;
+        bucket._tokens = burst;
+    }
+    else
+        bucket._tokens = std::min(burst, bucket._tokens + (double)(now - bucket._stamp) * rate / 1e9);
+    bucket._stamp = now;
+
+    if (bucket._tokens < 1)
+        return false;
+    bucket._tokens -= 1;
+    return true;
+}
+
+Admission AdmissionControl::admit(const struct sockaddr_in &client, std::string_view request, int queueFill)
+{
+    if (_queueLimit > 0 && queueFill > _queueLimit)
+    {
+        _dropped++;
+        return Admission::Drop;
+    }
+
+    if (_ipRate == 0 && _plidRate == 0)
+    {
+        _admitted++;
+        return Admission::Admit;
+    }
+
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+
+    if (_ipRate > 0 && !take(_ipBuckets, client.sin_addr.s_addr, _ipRate, now))
+    {
+        _overIpRate++;
+        return Admission::Reject;
+    }
+
+    int plid = requestPlid(request);
+    if (_plidRate > 0 && plid != -1 && !take(_plidBuckets, (uint32_t)plid, _plidRate, now))
+    {
+        _overPlidRate++;
+        return Admission::Reject;
+    }
+
+    _admitted++;
+    return Admission::Admit;
+}
+
+AdmissionStats AdmissionControl::stats()
+{
+    AdmissionStats stats;
+    stats._admitted = _admitted;
+    stats._overIpRate = _overIpRate;
+    stats._overPlidRate = _overPlidRate;
+    stats._dropped = _dropped;
+    return stats;
+}
@@ -0,0 +1,112 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "../common/constants.hpp"
+
+/**
+ * @brief What to do with a UDP request.
+ */
+enum class Admission
+{
+    Admit,  // handle it
+    Reject, // answer PROTOCOL_ERROR without handling it
+    Drop    // neither handle nor answer it
+};
+
+/**
+ * @brief Counters of an AdmissionControl, since the server started.
+ */
+struct AdmissionStats
+{
+    uint64_t _admitted = 0;
+    uint64_t _overIpRate = 0;   // Rejected, their source IP was over its rate
+    uint64_t _overPlidRate = 0; // Rejected, their PLID was over its rate
+    uint64_t _dropped = 0;      // Dropped while the receive queue was too full
+};
+
+/**
+ * @class AdmissionControl
+ * @brief Decides which UDP requests are handled, before they reach the
+ * CommandManager.
+ *
+ * Every source IP and every PLID has a token bucket, refilled at a fixed
+ * rate of requests per second and holding up to ADMISSION_BURST_SECONDS
+ * worth of them. A request finding either bucket empty is rejected. The
+ * buckets live in two fixed-size tables indexed by a hash of their key, so a
+ * flood of sources costs no memory: sources colliding in a slot share its
+ * bucket, so alternating between them gains no tokens.
+ *
+ * Independently, while the socket's receive queue is fuller than a given
+ * percentage of its buffer, the requests are dropped, since the server is
+ * already behind and the players will resend them.
+ */
+class AdmissionControl
+{
+private:
+    struct Bucket
+    {
+        bool _used = false;
+        double _tokens = 0;
+        int64_t _stamp = 0; // When _tokens was last refilled, in nanoseconds
+    };
+
+    static const size_t TABLE_SIZE = (size_t)1 << ADMISSION_TABLE_BITS;
+
+    std::vector<Bucket> _ipBuckets;
+    std::vector<Bucket> _plidBuckets;
+    std::array<std::mutex, ADMISSION_LOCK_STRIPES> _locks; // Each guards every ADMISSION_LOCK_STRIPES-th slot of both tables
+
+    int _ipRate = ADMISSION_IP_RATE;     // Requests per second, 0 for no limit
+    int _plidRate = ADMISSION_PLID_RATE; // Requests per second, 0 for no limit
+    int _queueLimit = ADMISSION_QUEUE_LIMIT; // Percentage of the receive buffer, 0 for no limit
+
+    std::atomic<uint64_t> _admitted{0};
+    std::atomic<uint64_t> _overIpRate{0};
+    std::atomic<uint64_t> _overPlidRate{0};
+    std::atomic<uint64_t> _dropped{0};
+
+    /**
+     * @brief Takes a token from the bucket of a key.
+     * @return false if the bucket is empty.
+     */
+    bool take(std::vector<Bucket> &table, uint32_t key, int rate, int64_t now);
+
+public:
+    AdmissionControl();
+
+    /**
+     * @brief Sets the limits, 0 disabling each of them.
+     * Must be called before the requests are admitted.
+     * @param ipRate Requests per second per source IP.
+     * @param plidRate Requests per second per PLID.
+     * @param queueLimit Percentage of the receive buffer above which
+     * requests are dropped.
+     */
+    void setLimits(int ipRate, int plidRate, int queueLimit);
+
+    /**
+     * @brief Whether admit() needs the fill of the receive queue.
+     */
+    bool watchesQueue();
+
+    /**
+     * @brief Decides what to do with a request.
+     * @param client Where the request came from.
+     * @param request The request, its PLID read if it has one.
+     * @param queueFill Percentage of the receive buffer in use.
+     */
+    Admission admit(const struct sockaddr_in &client, std::string_view request, int queueFill);
+
+    AdmissionStats stats();
+};
+
+#endif
@@ -1,70 +1,63 @@
 #include "commands.hpp"
 
-void CommandManager::registerCommand(std::shared_ptr<CommandHandler> command)
+void CommandManager::handleCommand(std::string_view message, std::string &response, Server &receiver,
+                                   FileBody *body)
 {
-    try
+    // the identifier must be followed by a space, the delimiter or nothing
+    if (message.size() < 3 || (message.size() > 3 && message[3] != ' ' && message[3] != '\n'))
     {
-        _handlers.insert({command->_name, command});
+        response = "ERR";
+        return;
     }
-    catch (const std::exception &e)
+
+    switch (packOpcode(message.data()))
     {
-        std::cerr << e.what() << '\n';
+    case StartCommand::OPCODE:
+        StartCommand::handle(message, response, receiver);
+        break;
+    case TryCommand::OPCODE:
+        TryCommand::handle(message, response, receiver);
+        break;
+    case ShowTrialsCommand::OPCODE:
+        ShowTrialsCommand::handle(message, response, receiver, body);
+        break;
+    case ScoreboardCommand::OPCODE:
+        ScoreboardCommand::handle(message, response, receiver, body);
+        break;
+    case QuitCommand::OPCODE:
+        QuitCommand::handle(message, response, receiver);
+        break;
+    case DebugCommand::OPCODE:
+        DebugCommand::handle(message, response, receiver);
+        break;
+    default:
+        std::cout << "Invalid command: " << message.substr(0, 3) << std::endl;
+        response = "ERR";
+        break;
     }
-    return;
 }
 
-void CommandManager::registerAllCommands()
+void CommandManager::handleTcpCommand(std::string_view message, std::string &response, Server &receiver,
+                                      FileBody *body)
 {
-    this->registerCommand(std::make_shared<StartCommand>());
-    this->registerCommand(std::make_shared<TryCommand>());
-    this->registerCommand(std::make_shared<QuitCommand>());
-    this->registerCommand(std::make_shared<ShowTrialsCommand>());
-    this->registerCommand(std::make_shared<ScoreboardCommand>());
-    this->registerCommand(std::make_shared<ExitCommand>());
-    this->registerCommand(std::make_shared<DebugCommand>());
+    if (message.size() >= 3 && (packOpcode(message.data()) == ShowTrialsCommand::OPCODE ||
+                                packOpcode(message.data()) == ScoreboardCommand::OPCODE))
+        handleCommand(message, response, receiver, body);
+    else
+        response = PROTOCOL_ERROR "\n";
 }
 
-std::string CommandManager::handleCommand(std::string message, Server &receiver)
+void StartCommand::handle(std::string_view args, std::string &response, Server &receiver)
 {
-    std::vector<std::string> command_split = split_command(message);
-
-    if (command_split.size() == 0)
-        return "ERR";
-
-    std::string commandName = command_split[0]; // The name of the command
-
-    if (commandName.length() == 0 || commandName.length() != 3)
-        return "ERR";
-
-    auto handler = _handlers.find(commandName); // find handler of the command
-
-    if (handler == _handlers.end())
-    { // If the handler does not exist
-        handler = _handlers.find(commandName);
-        if (handler == _handlers.end())
-        {
-            std::cout << "Invalid command: " << commandName << std::endl;
-            return "ERR";
-        }
-    }
-
-    std::string response;
-    handler->second->handle(message, response, receiver);
-
-    return response;
-}
-
-void StartCommand::handle(std::string &args, std::string &response, Server &receiver)
-{
-    GamedataManager DB = receiver._DB;
+    GamedataManager &DB = receiver._DB;
 
     StartCommunication startComm;
 
     try
     {
-        StreamMessage reqMessage(args);
-        startComm.decodeRequest(reqMessage); // Decode the request
+        startComm.decodeRequest(args); // Decode the request
         std::string plid = std::to_string(startComm._plid);
+        std::lock_guard<std::mutex> lock(DB.playerLock(startComm._plid));
 
         // check database if player has an ongoing game
         bool hasGame = DB.hasOngoingGame(plid);
@@ -91,7 +84,7 @@ void StartCommand::handle(std::string &args, std::string &response, Server &rece
     { // If the protocol is not valid, status = "ERR"
         startComm._status = "ERR";
     }
-    response = startComm.encodeResponse(); // Encode the response
+    startComm.encodeResponse(response); // Encode the response
 
     if (receiver.isverbose())
     {
@@ -102,16 +95,16 @@ void StartCommand::handle(std::string &args, std::string &response, Server &rece
     return;
 }
 
-void TryCommand::handle(std::string &args, std::string &response, Server &receiver)
+void TryCommand::handle(std::string_view args, std::string &response, Server &receiver)
 {
-    GamedataManager DB = receiver._DB;
+    GamedataManager &DB = receiver._DB;
 
     TryCommunication tryComm;
 
     try
     {
-        StreamMessage reqMessage(args);
-        tryComm.decodeRequest(reqMessage); // Decode the request
+        tryComm.decodeRequest(args); // Decode the request
+        std::lock_guard<std::mutex> lock(DB.playerLock(tryComm._plid));
 
         // check database if player has an ongoing game
         bool hasGame = DB.hasOngoingGame(std::to_string(tryComm._plid));
@@ -175,7 +168,7 @@ void TryCommand::handle(std::string &args, std::string &response, Server &receiv
     { // If the protocol is not valid, status = "ERR"
         tryComm._status = "ERR";
     }
-    response = tryComm.encodeResponse(); // Encode the response
+    tryComm.encodeResponse(response); // Encode the response
     if (receiver.isverbose())
     {
         std::cout << "Try Request by: " << tryComm._plid << std::endl;
@@ -184,17 +177,18 @@ void TryCommand::handle(std::string &args, std::string &response, Server &receiv
     return;
 }
 
-void ShowTrialsCommand::handle(std::string &args, std::string &response, Server &receiver)
+void ShowTrialsCommand::handle(std::string_view args, std::string &response, Server &receiver,
+                               FileBody *body)
 {
-    GamedataManager DB = receiver._DB;
+    GamedataManager &DB = receiver._DB;
     ShowTrialsCommunication stComm;
 
     try
     {
-        StreamMessage reqMessage(args);
-        stComm.decodeRequest(reqMessage); // Decode the request
+        stComm.decodeRequest(args); // Decode the request
 
         std::string plid = std::to_string(stComm._plid);
+        std::lock_guard<std::mutex> lock(DB.playerLock(stComm._plid));
 
         bool hasGame = DB.hasOngoingGame(plid); // check if theres an ongoing game
         if (hasGame)
@@ -205,8 +199,15 @@ void ShowTrialsCommand::handle(std::string &args, std::string &response, Server
         }
         else if (DB.hasGames(plid)) // if no ongoing game, check if there was ever a game
         {                           // send text with most recent game
-            DB.getMostRecentGameData(plid, stComm._Fname,
-                                     stComm._Fsize, stComm._Fdata);
+            if (body != nullptr)
+            {
+                body->_fd = DB.getMostRecentGameFile(plid, stComm._Fname, stComm._Fsize);
+                body->_size = (size_t)stComm._Fsize + 1; // and the delimiter
+                stComm._FdataFollows = true;
+            }
+            else
+                DB.getMostRecentGameData(plid, stComm._Fname,
+                                         stComm._Fsize, stComm._Fdata);
             stComm._status = "FIN";
         }
         else
@@ -216,7 +217,7 @@ void ShowTrialsCommand::handle(std::string &args, std::string &response, Server
     { // If the protocol is not valid, status = "ERR"
         stComm._status = "ERR";
     }
-    response = stComm.encodeResponse(); // Encode the response
+    stComm.encodeResponse(response); // Encode the response
     if (receiver.isverbose())
     {
         std::cout << "Show Trials Request by: " << stComm._plid << std::endl;
@@ -225,33 +226,35 @@ void ShowTrialsCommand::handle(std::string &args, std::string &response, Server
     return;
 }
 
-void ScoreboardCommand::handle(std::string &args, std::string &response, Server &receiver)
+void ScoreboardCommand::handle(std::string_view args, std::string &response, Server &receiver,
+                               FileBody *body)
 {
-    SCORELIST list;
-
-    GamedataManager DB = receiver._DB;
+    GamedataManager &DB = receiver._DB;
     ScoreboardCommunication sbComm;
 
     try
     {
-        StreamMessage reqMessage(args);
-        sbComm.decodeRequest(reqMessage); // Decode the request
+        sbComm.decodeRequest(args); // Decode the request
 
-        int nscores = findTopScores(&list);
+        int nscores;
+        if (body != nullptr)
+        {
+            nscores = DB.getScoreboardFile(sbComm._Fname, sbComm._Fsize, body->_fd);
+            body->_size = nscores ? (size_t)sbComm._Fsize + 1 : 0; // and the delimiter
+            sbComm._FdataFollows = nscores != 0;
+        }
+        else
+            nscores = DB.getScoreboard(sbComm._Fname, sbComm._Fsize, sbComm._Fdata);
         if (!nscores)
             sbComm._status = "EMPTY";
-
         else
-        {
-            DB.formatScoreboard(&list, sbComm._Fname, sbComm._Fsize, sbComm._Fdata, nscores);
             sbComm._status = "OK";
-        }
     }
     catch (ProtocolException &e)
     { // If the protocol is not valid, status = "ERR"
         sbComm._status = "ERR";
     }
-    response = sbComm.encodeResponse();
+    sbComm.encodeResponse(response);
     if (receiver.isverbose())
     {
         std::cout << "ScoreBoard Request" << std::endl;
@@ -261,15 +264,15 @@ void ScoreboardCommand::handle(std::string &args, std::string &response, Server
     return;
 }
 
-void QuitCommand::handle(std::string &args, std::string &response, Server &receiver)
+void QuitCommand::handle(std::string_view args, std::string &response, Server &receiver)
 {
-    GamedataManager DB = receiver._DB;
+    GamedataManager &DB = receiver._DB;
 
     QuitCommunication quitComm;
     try
     {
-        StreamMessage reqMessage(args);
-        quitComm.decodeRequest(reqMessage); // Decode the request
+        quitComm.decodeRequest(args); // Decode the request
+        std::lock_guard<std::mutex> lock(DB.playerLock(quitComm._plid));
 
         bool hasGame = DB.hasOngoingGame(std::to_string(quitComm._plid));
         if (hasGame) // exit game
@@ -287,7 +290,7 @@ void QuitCommand::handle(std::string &args, std::string &response, Server &recei
     { // If the protocol is not valid, set the status to ERR
         quitComm._status = "ERR";
     }
-    response = quitComm.encodeResponse(); // Encode the response
+    quitComm.encodeResponse(response); // Encode the response
     if (receiver.isverbose())
     {
         std::cout << "Quit Request by: " << quitComm._plid << std::endl;
@@ -296,53 +299,17 @@ void QuitCommand::handle(std::string &args, std::string &response, Server &recei
     return;
 }
 
-void ExitCommand::handle(std::string &args, std::string &response, Server &receiver)
-{
-    GamedataManager DB = receiver._DB;
-
-    QuitCommunication exitComm;
-
-    try
-    {
-        StreamMessage reqMessage(args);
-        exitComm.decodeRequest(reqMessage); // Decode the request
-
-        bool hasGame = DB.hasOngoingGame(std::to_string(exitComm._plid));
-        if (hasGame) // exit game
-        {
-            std::string key = DB.getsecretKey(std::to_string(exitComm._plid));
-            exitComm._key = DB.formatSecretKey(key);
-            DB.quitGame(std::to_string(exitComm._plid));
-
-            exitComm._status = "OK"; // Set the status to OK if everything goes right
-        }
-        else
-            exitComm._status = "NOK";
-    }
-    catch (ProtocolException &e)
-    { // If the protocol is not valid, set the status to ERR
-        exitComm._status = "ERR";
-    }
-    response = exitComm.encodeResponse(); // Encode the response
-    if (receiver.isverbose())
-    {
-        std::cout << "Exit Request by: " << exitComm._plid << std::endl;
-        std::cout << "Response: " << response;
-    }
-    return;
-}
-
-void DebugCommand::handle(std::string &args, std::string &response, Server &receiver)
+void DebugCommand::handle(std::string_view args, std::string &response, Server &receiver)
 {
-    GamedataManager DB = receiver._DB;
+    GamedataManager &DB = receiver._DB;
 
     DebugCommunication dbgComm;
 
     try
     {
-        StreamMessage reqMessage(args);
-        dbgComm.decodeRequest(reqMessage); // Decode the request
+        dbgComm.decodeRequest(args); // Decode the request
         std::string plid = std::to_string(dbgComm._plid);
+        std::lock_guard<std::mutex> lock(DB.playerLock(dbgComm._plid));
 
         // check database if player has an ongoing game
         bool hasGame = DB.hasOngoingGame(plid);
@@ -366,7 +333,7 @@ void DebugCommand::handle(std::string &args, std::string &response, Server &rece
     { // If the protocol is not valid, status = "ERR"
         dbgComm._status = "ERR";
     }
-    response = dbgComm.encodeResponse(); // Encode the response
+    dbgComm.encodeResponse(response); // Encode the response
     if (receiver.isverbose())
     {
         std::cout << "Debug Request by: " << dbgComm._plid << std::endl;
@@ -375,21 +342,6 @@ void DebugCommand::handle(std::string &args, std::string &response, Server &rece
     return;
 }
 
-std::vector<std::string> split_command(std::string input)
-{
-    std::stringstream ss(input); // Create a stringstream object
-    std::string temp;
-    std::vector<std::string> command_split;
-
-    // Splitting the input string by space
-    while (std::getline(ss, temp, ' '))
-    {
-        temp.erase(std::remove_if(temp.begin(), temp.end(), ::isspace), temp.end());
-        command_split.push_back(temp);
-    }
-    return command_split;
-}
-
 std::string removeSpaces(std::string &str)
 {
     std::string result = str;
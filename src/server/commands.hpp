@@ -13,104 +13,93 @@
 #include "../common/protocol.hpp"
 #include "server.hpp"
 
-class CommandHandler
+/**
+ * @brief Dispatches each request to the handler of its command.
+ *
+ * The first three bytes of a request are packed into an opcode and
+ * switched on, so no tokenization, lookup or virtual call happens before
+ * the handler runs.
+ */
+class CommandManager
 {
 public:
-    std::string _name; // The name of the command
-    bool _isTCP;       // Specifies whether command is tcp or udp
-
     /**
-     * @brief Handles the command with the given arguments.
-     * should be implemented by derived classes
+     * @brief Handles a request, writing the reply into response.
+     *
+     * @param message The request.
+     * @param response Replaced by the reply, keeping its capacity.
+     * @param receiver The server configuration and database.
+     * @param body If given, a file the reply continues with after response,
+     * for senders able to stream it with sendfile(). Otherwise the whole reply
+     * is written into response.
      */
-    virtual void handle(std::string &args, std::string &response, Server &receiver) = 0;
+    void handleCommand(std::string_view message, std::string &response, Server &receiver,
+                       FileBody *body = nullptr);
 
-protected:
     /**
-     * @brief Constructs a CommandHandler object with the specified properties.
+     * @brief Handles a request received over TCP, where only the queries
+     * (STR/SSB) are served.
+     *
+     * The games only change over UDP, so a connection still drained by a
+     * process that handed its sockets over cannot touch the games the next
+     * process took over.
      *
-     * @param name The name of the command.
+     * @param message The request.
+     * @param response Replaced by the reply, keeping its capacity.
+     * @param receiver The server configuration and database.
+     * @param body A file the reply continues with after response.
      */
-
-    CommandHandler(const std::string &name, bool isTCP)
-        : _name{name},
-          _isTCP{isTCP} {}
+    void handleTcpCommand(std::string_view message, std::string &response, Server &receiver,
+                          FileBody *body);
 };
 
-class CommandManager
+class StartCommand
 {
-    std::unordered_map<std::string, std::shared_ptr<CommandHandler>> _handlers;
-
 public:
-    /**
-     * @brief Adds a command to the command manager.
-     *
-     * @param handler The command handler to add.
-     */
-    void registerCommand(std::shared_ptr<CommandHandler> handle);
-
-    void registerAllCommands();
+    static const uint32_t OPCODE = packOpcode("SNG"); // Served over UDP
 
-    std::string handleCommand(std::string message, Server &receiver);
+    static void handle(std::string_view args, std::string &response, Server &receiver);
 };
 
-class StartCommand : public CommandHandler
+class TryCommand
 {
-    void handle(std::string &args, std::string &response, Server &receiver);
-
 public:
-    StartCommand() : CommandHandler("SNG", false) {}
-};
-
-class TryCommand : public CommandHandler
-{
-    void handle(std::string &args, std::string &response, Server &receiver);
+    static const uint32_t OPCODE = packOpcode("TRY"); // Served over UDP
 
-public:
-    TryCommand() : CommandHandler("TRY", false) {}
+    static void handle(std::string_view args, std::string &response, Server &receiver);
 };
 
-class ShowTrialsCommand : public CommandHandler
+class ShowTrialsCommand
 {
-    void handle(std::string &args, std::string &response, Server &receiver);
-
 public:
-    ShowTrialsCommand() : CommandHandler("STR", true) {}
-};
+    static const uint32_t OPCODE = packOpcode("STR"); // Served over TCP
 
-class ScoreboardCommand : public CommandHandler
-{
-    void handle(std::string &args, std::string &response, Server &receiver);
-
-public:
-    ScoreboardCommand() : CommandHandler("SSB", true) {}
+    static void handle(std::string_view args, std::string &response, Server &receiver, FileBody *body);
 };
 
-class QuitCommand : public CommandHandler
+class ScoreboardCommand
 {
-    void handle(std::string &args, std::string &response, Server &receiver);
-
 public:
-    QuitCommand() : CommandHandler("QUT", false) {}
+    static const uint32_t OPCODE = packOpcode("SSB"); // Served over TCP
+
+    static void handle(std::string_view args, std::string &response, Server &receiver, FileBody *body);
 };
 
-class ExitCommand : public CommandHandler
+class QuitCommand
 {
-    void handle(std::string &args, std::string &response, Server &receiver);
-
 public:
-    ExitCommand() : CommandHandler("QUT", false) {}
+    static const uint32_t OPCODE = packOpcode("QUT"); // Served over UDP
+
+    static void handle(std::string_view args, std::string &response, Server &receiver);
 };
 
-class DebugCommand : public CommandHandler
+class DebugCommand
 {
-    void handle(std::string &args, std::string &response, Server &receiver);
-
 public:
-    DebugCommand() : CommandHandler("DBG", false) {}
-};
+    static const uint32_t OPCODE = packOpcode("DBG"); // Served over UDP
 
-std::vector<std::string> split_command(std::string input);
+    static void handle(std::string_view args, std::string &response, Server &receiver);
+};
 
 std::string currentDateTime();
 
@@ -1,6 +1,12 @@
 #include "database.hpp"
 #include <filesystem>
 #include <regex>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
 
 #include <ctime>
 
@@ -15,6 +21,13 @@ bool DatabaseManager::openFile(std::fstream &fileStream,
     return true;
 }
 
+void DatabaseManager::deleteFile(std::string path)
+{
+    std::error_code error;
+    if (!std::filesystem::remove(path, error) && error)
+        throw UnrecoverableError("Unable to delete file: " + path);
+}
+
 void DatabaseManager::createDir(std::string path)
 {
     try
@@ -70,24 +83,18 @@ void DatabaseManager::writeToFile(std::string path, std::string content)
     }
 }
 
-std::string DatabaseManager::renameFile(std::string code)
+void DatabaseManager::replaceFile(std::string path, std::string content)
 {
-    // yyyy-mm-dd hh-mm-ss
-    std::string timedate = currentDateTimeFN();
+    // unique among the processes and threads that may replace the same file
+    std::ostringstream temporary;
+    temporary << path << "." << getpid() << "." << std::this_thread::get_id() << ".tmp";
 
-    std::string filename;
-
-    for (char c : timedate)
+    writeToFile(temporary.str(), content);
+    if (rename(temporary.str().c_str(), path.c_str()) == -1)
     {
-        if (c == '-')
-            continue;
-        else if (c == ' ')
-            filename += '_';
-        else
-            filename += c;
+        deleteFile(temporary.str());
+        throw UnrecoverableError("Couldn't replace file: " + path, errno);
     }
-    filename += '_' + code + ".txt";
-    return filename;
 }
 
 void DatabaseManager::appendToFile(std::string path, std::string content)
@@ -125,26 +132,599 @@ int DatabaseManager::countLinesInFile(std::fstream &fileStream)
 }
 
 GamedataManager::GamedataManager()
+    : _generations(new std::atomic<uint32_t>[PLID_COUNT]()), _expiries(time(NULL)), _journal(JOURNAL_DIR),
+      _persistence(*this)
 {
     createDir(FILES_DIR);
     createDir(GAMES_DIR);
     createDir(SCORES_DIR);
+    createDir(SHEETS_DIR);
+
+    // warm start: the ongoing games and the best scores as the last process
+    // left them in shared memory, without reading the journal or any text
+    // file. The finished games are read per player, when first needed.
+    std::vector<JournalRecord> live;
+    uint32_t journalSegment;
+    uint64_t journalSize;
+    _segment.open(FILES_DIR);
+    _journal.resume();
+    _journal.position(journalSegment, journalSize);
+    bool warm = _segment.load(journalSegment, journalSize, live) && _segment.loadScores(_topScores);
+
+    _segment.reset();
+    if (warm)
+    {
+        for (auto &record : live)
+            applyRecord(record);
+        std::cout << "Ongoing games and best scores loaded from shared memory" << std::endl;
+        return;
+    }
+
+    replayJournal();
+    loadGames();
+    _persistence.flush(); // the replay may have written game and score files
+    loadScores();
 }
 
-bool GamedataManager::hasOngoingGame(std::string plid)
+// Records of the journal
+
+static JournalRecord startRecord(const Game &game)
 {
-    try
+    JournalRecord record{};
+    record._type = JournalRecord::Start;
+    record._plid = (uint32_t)std::stoi(game._plid);
+    record._time = (int64_t)game._startTime;
+    record._mode = game._mode;
+    record._duration = (uint16_t)game._duration;
+    memcpy(record._key, game._key.data(), KEY_SIZE);
+    return record;
+}
+
+static JournalRecord tryRecord(const Game &game, const Trial &trial)
+{
+    JournalRecord record{};
+    record._type = JournalRecord::Try;
+    record._plid = (uint32_t)std::stoi(game._plid);
+    record._time = (int64_t)game._startTime + trial._time;
+    record._nB = (uint8_t)trial._nB;
+    record._nW = (uint8_t)trial._nW;
+    memcpy(record._key, trial._key.data(), KEY_SIZE);
+    return record;
+}
+
+static JournalRecord endRecord(const Game &game, std::string code, int score, time_t endTime)
+{
+    JournalRecord record{};
+    record._type = JournalRecord::End;
+    record._plid = (uint32_t)std::stoi(game._plid);
+    record._time = (int64_t)endTime;
+    record._code = code[0];
+    record._score = (uint16_t)score;
+    return record;
+}
+
+// Sequence number of the last record committed by this thread and not yet
+// waited for, 0 if none
+static thread_local uint64_t lastCommit = 0;
+
+void GamedataManager::commit(const JournalRecord &record, const std::function<void()> &then)
+{
+    // the append and the change to the games happen together, so a compaction
+    // never sees one without the other
+    std::lock_guard<std::mutex> lock(_journalLock);
+
+    lastCommit = _journal.append(record);
+    applyRecord(record);
+    if (then)
+        then();
+
+    if (_journal.full())
+        compactJournal();
+}
+
+void GamedataManager::setDurability(Durability durability, std::chrono::microseconds delay)
+{
+    _journal.setDurability(durability, delay);
+}
+
+void GamedataManager::setIoEngine(IoEngine engine)
+{
+    _persistence.setEngine(engine);
+}
+
+// Generations bumped by this thread
+static thread_local uint32_t generationBumps = 0;
+
+uint32_t GamedataManager::gameGeneration(int plid)
+{
+    if (plid < 0 || plid >= PLID_COUNT)
+        return 0;
+    return _generations[(size_t)plid].load();
+}
+
+uint32_t GamedataManager::ownGenerationBumps()
+{
+    return generationBumps;
+}
+
+void GamedataManager::waitDurable()
+{
+    if (lastCommit == 0)
+        return;
+
+    _journal.waitDurable(lastCommit);
+    lastCommit = 0;
+}
+
+void GamedataManager::printStats(std::ostream &out)
+{
+    JournalStats stats = _journal.stats();
+
+    out << "journal: " << stats._syncs << " syncs, " << stats._syncedRecords << " records";
+    if (stats._syncs > 0)
+        out << ", " << (double)stats._syncedRecords / (double)stats._syncs << " records/sync"
+            << ", commit latency avg " << stats._latencyTotalUs / stats._syncs << "us"
+            << " max " << stats._latencyMaxUs << "us";
+    out << std::endl;
+}
+
+// The STR body of an ongoing game is rendered as the game progresses, so
+// getCurrentGameData() only formats the trial count and the remaining time
+
+static void renderSheetHeader(Game &game)
+{
+    game._sheetHeader = "\n\tActive game found for player " + game._plid + "\n" +
+                        "Game initiated: " + game._dateTime + " with " + std::to_string(game._duration) +
+                        " seconds to be completed\n";
+}
+
+static void renderSheetTrial(Game &game, const Trial &trial)
+{
+    game._sheetTrials += "Trial: " + trial._key + ", nB: " + std::to_string(trial._nB) +
+                         ", nW: " + std::to_string(trial._nW) + " at " + std::to_string(trial._time) + "s\n";
+}
+
+void GamedataManager::applyRecord(const JournalRecord &record)
+{
+    std::string plid = std::to_string(record._plid);
+    if (record._type != JournalRecord::Try && record._plid < PLID_COUNT)
     {
-        validate_plid(plid);
-        // ongoing games are stored in the GAMES directory
-        std::string path = GAMES_DIR + gameFileName(plid);
+        _generations[record._plid]++;
+        generationBumps++;
+    }
+
+    switch (record._type)
+    {
+    case JournalRecord::Start:
+    {
+        Game game{plid, record._mode, std::string(record._key, KEY_SIZE), record._duration,
+                  formatDateTime((time_t)record._time), (time_t)record._time, {}};
+        renderSheetHeader(game);
+        insertGame(std::move(game));
+
+        std::lock_guard<std::mutex> lock(_expiriesLock);
+        _expiries.schedule((int)record._plid, (time_t)record._time + record._duration);
+        break;
+    }
+    case JournalRecord::Try:
+    {
+        Game *game = findGame(plid);
+        if (game != nullptr)
+        {
+            game->_trials.push_back(Trial{std::string(record._key, KEY_SIZE), record._nB, record._nW,
+                                          (long int)(record._time - (int64_t)game->_startTime)});
+            renderSheetTrial(*game, game->_trials.back());
+        }
+        break;
+    }
+    case JournalRecord::End:
+        eraseGame(plid);
+        break;
+    default:
+        break;
+    }
+    _segment.apply(record);
+}
+
+void GamedataManager::replayJournal()
+{
+    _journal.replay([this](const JournalRecord &record)
+                    {
+        if (record._type != JournalRecord::End)
+        {
+            applyRecord(record);
+            return;
+        }
+
+        Game *game = findGame(std::to_string(record._plid));
+        if (game == nullptr)
+            return;
+
+        // the server may have stopped before the game's files were written
+        Game finished = *game;
+        std::string code(1, record._code);
+        applyRecord(record);
+        if (!std::filesystem::exists(archivePath(finished, code, (time_t)record._time)))
+            finishGame(finished, code, record._score, (time_t)record._time); });
+}
+
+void GamedataManager::compactJournal()
+{
+    // the records of the finished games are dropped, so their files must
+    // be on disk first, and not only in the page cache
+    if (!_persistence.sync())
+        return; // tried again on the next commit, as the journal is still full
+
+    _journal.compact(liveRecords());
+}
+
+std::vector<JournalRecord> GamedataManager::liveRecords()
+{
+    std::vector<JournalRecord> live;
+    std::lock_guard<std::mutex> lock(_gamesLock);
+    _players.forEach([&live](int, Player &player)
+                     {
+        if (player._game == nullptr)
+            return;
+        live.push_back(startRecord(*player._game));
+        for (auto &trial : player._game->_trials)
+            live.push_back(tryRecord(*player._game, trial)); });
+    return live;
+}
+
+void GamedataManager::loadScores()
+{
+    struct dirent **fileList;
+    _topScores.clear();
+
+    // same order as the scoreboard: alphabetical, from the last file
+    int n_entries = scandir(SCORES_DIR, &fileList, nullptr, alphasort);
+    if (n_entries <= 0)
+        return;
+
+    while (n_entries--)
+    {
+        std::string fileName = fileList[n_entries]->d_name;
+        free(fileList[n_entries]);
+
+        if (fileName[0] == '.' || _topScores.size() >= SCOREBOARD_SIZE)
+            continue;
+
         std::fstream fileStream;
-        if (!openFile(fileStream, path, std::ios::in))
+        if (!openFile(fileStream, SCORES_DIR + fileName, std::ios::in))
+            continue;
+
+        // SSS PLID key nT mode
+        std::string line;
+        std::getline(fileStream, line);
+        try
+        {
+            ScoreEntry entry;
+            entry._fileName = fileName;
+            entry._score = std::stoi(getiword(line, 1));
+            entry._plid = getiword(line, 2);
+            entry._key = getiword(line, 3);
+            entry._nT = std::stoi(getiword(line, 4));
+            entry._mode = getiword(line, 5) == "DEBUG" ? MODEDEBUG : MODEPLAY;
+            _topScores.push_back(entry);
+        }
+        catch (std::exception &e)
         {
-            return false;
+            continue; // malformed score file
         }
+    }
+    free(fileList);
+}
+
+void GamedataManager::addScore(ScoreEntry entry)
+{
+    std::lock_guard<std::mutex> lock(_scoresLock);
+
+    // scores are ordered by file name, from the last one
+    auto position = std::upper_bound(_topScores.begin(), _topScores.end(), entry,
+                                     [](const ScoreEntry &a, const ScoreEntry &b)
+                                     { return a._fileName > b._fileName; });
+    if (position - _topScores.begin() >= SCOREBOARD_SIZE)
+        return; // not among the best, the scoreboard is unchanged
+
+    _topScores.insert(position, entry);
+    if (_topScores.size() > SCOREBOARD_SIZE)
+        _topScores.pop_back();
+    _scoreboardStale = true;
+}
+
+int GamedataManager::refreshScoreboard()
+{
+    int nscores = (int)_topScores.size();
+    if (nscores == 0 || !_scoreboardStale)
+        return nscores;
+
+    SCORELIST list;
+    for (int i = 0; i < nscores; i++)
+    {
+        ScoreEntry &entry = _topScores[(size_t)i];
+        list.score[i] = entry._score;
+        strncpy(list.PLID[i], entry._plid.c_str(), sizeof(list.PLID[i]) - 1);
+        list.PLID[i][sizeof(list.PLID[i]) - 1] = '\0';
+        strncpy(list.color_code[i], entry._key.c_str(), sizeof(list.color_code[i]) - 1);
+        list.color_code[i][sizeof(list.color_code[i]) - 1] = '\0';
+        list.ntries[i] = entry._nT;
+        list.mode[i] = entry._mode;
+    }
+    if (nscores < SCOREBOARD_SIZE)
+        list.score[nscores] = 0;
+
+    std::string fName;
+    _scoreboardData.clear();
+    formatScoreboard(&list, fName, _scoreboardSize, _scoreboardData, nscores);
+    replaceFile(SHEETS_DIR "TOPSCORES.txt", _scoreboardData);
+    _scoreboardStale = false;
+    return nscores;
+}
+
+int GamedataManager::getScoreboard(std::string &fName, int &fSize, std::string &fdata)
+{
+    std::lock_guard<std::mutex> lock(_scoresLock);
+
+    int nscores = refreshScoreboard();
+    if (nscores == 0)
+        return 0;
+
+    // only the file name changes between requests, as it carries the time
+    fName = "TOPSCORE_" + truncateDate(currentDateTimeFN()) + ".txt";
+    fSize = _scoreboardSize;
+    fdata = _scoreboardData;
+    return nscores;
+}
+
+int GamedataManager::getScoreboardFile(std::string &fName, int &fSize, int &fd)
+{
+    std::lock_guard<std::mutex> lock(_scoresLock);
+
+    int nscores = refreshScoreboard();
+    if (nscores == 0)
+        return 0;
+
+    // opened under the lock, so the file matches _scoreboardSize
+    fd = open(SHEETS_DIR "TOPSCORES.txt", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw UnrecoverableError("Unable to open file: " SHEETS_DIR "TOPSCORES.txt", errno);
+
+    fName = "TOPSCORE_" + truncateDate(currentDateTimeFN()) + ".txt";
+    fSize = _scoreboardSize;
+    return nscores;
+}
+
+void GamedataManager::loadGames()
+{
+    std::regex pattern("^GAME_[0-9]{6}\\.txt$");
+
+    for (auto entry : std::filesystem::directory_iterator(GAMES_DIR))
+    {
+        std::string fileName = entry.path().filename().string();
+        if (!entry.is_regular_file() || !std::regex_match(fileName, pattern))
+            continue;
+
+        std::fstream fileStream;
+        if (!openFile(fileStream, entry.path().string(), std::ios::in))
+            continue;
+
+        // first line: PLID mode key duration yyyy-mm-dd hh:mm:ss time
+        std::string line;
+        std::getline(fileStream, line);
+
+        Game game;
+        game._plid = getiword(line, 1);
+        game._mode = getiword(line, 2)[0];
+        game._key = getiword(line, 3);
+        try
+        {
+            game._duration = std::stoi(getiword(line, 4));
+            game._dateTime = getiword(line, 5) + ' ' + getiword(line, 6);
+            game._startTime = (time_t)std::stol(getiword(line, 7));
+
+            // remaining lines: T: key nB nW time
+            while (std::getline(fileStream, line))
+            {
+                Trial trial;
+                trial._key = getiword(line, 2);
+                trial._nB = std::stoi(getiword(line, 3));
+                trial._nW = std::stoi(getiword(line, 4));
+                trial._time = std::stol(getiword(line, 5));
+                game._trials.push_back(trial);
+            }
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << "Ignoring malformed game file: " << fileName << std::endl;
+            continue;
+        }
+
         fileStream.close();
-        return true;
+
+        // games already in the journal take precedence
+        if (findGame(game._plid) == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(playerLock(std::stoi(game._plid)));
+            commit(startRecord(game));
+            for (auto &trial : game._trials)
+                commit(tryRecord(game, trial));
+        }
+        deleteFile(entry.path().string());
+    }
+}
+
+Game &GamedataManager::ongoingGame(std::string plid)
+{
+    Game *game = findGame(plid);
+    if (game == nullptr)
+        throw UnrecoverableError("No ongoing game for player " + plid);
+    return *game;
+}
+
+Game *GamedataManager::findGame(std::string plid)
+{
+    std::lock_guard<std::mutex> lock(_gamesLock);
+
+    Player *player = _players.find(std::stoi(plid));
+    if (player == nullptr)
+        return nullptr;
+    return player->_game.get();
+}
+
+void GamedataManager::insertGame(Game game)
+{
+    std::lock_guard<std::mutex> lock(_gamesLock);
+
+    int plid = std::stoi(game._plid);
+    _players.at(plid)._game = std::make_unique<Game>(std::move(game));
+}
+
+void GamedataManager::eraseGame(std::string plid)
+{
+    std::lock_guard<std::mutex> lock(_gamesLock);
+
+    Player *player = _players.find(std::stoi(plid));
+    if (player != nullptr)
+        player->_game.reset();
+}
+
+// Names of the finished game files
+
+static std::string finishedFileName(const FinishedGame &game)
+{
+    return formatDateTimeFN(game._endTime) + "_" + game._code + ".txt";
+}
+
+/**
+ * @brief Parses the name of a finished game file, yyyymmdd_hhmmss_C.txt.
+ * @return false if name is not one.
+ */
+static bool parseFinishedFileName(const std::string &name, FinishedGame &game)
+{
+    struct tm date = {};
+    char code;
+    int length = 0;
+    if (sscanf(name.c_str(), "%4d%2d%2d_%2d%2d%2d_%c.txt%n", &date.tm_year, &date.tm_mon,
+               &date.tm_mday, &date.tm_hour, &date.tm_min, &date.tm_sec, &code, &length) != 7 ||
+        (size_t)length != name.length())
+        return false;
+
+    date.tm_year -= 1900;
+    date.tm_mon -= 1;
+    game._endTime = timegm(&date);
+    game._code = code;
+    return true;
+}
+
+static bool finishedBefore(const FinishedGame &a, const FinishedGame &b)
+{
+    // same order as the file names
+    return a._endTime < b._endTime || (a._endTime == b._endTime && a._code < b._code);
+}
+
+std::vector<FinishedGame> &GamedataManager::finishedGames(std::string plid)
+{
+    Player &player = _players.at(std::stoi(plid));
+    if (player._loaded)
+        return player._finished;
+    player._loaded = true;
+
+    std::string path = GAMES_DIR + playerDirectory(plid);
+    std::string indexPath = path + "/" GAMES_INDEX;
+    std::vector<FinishedGame> &finished = player._finished;
+    FinishedGame game;
+
+    // creating a game file updates the directory, and the game is added
+    // to the index right after, so an older index misses some game
+    struct stat directory, index;
+    if (stat(path.c_str(), &directory) == -1)
+        return finished; // never finished a game
+    bool indexed = stat(indexPath.c_str(), &index) == 0 &&
+                   (index.st_mtim.tv_sec > directory.st_mtim.tv_sec ||
+                    (index.st_mtim.tv_sec == directory.st_mtim.tv_sec &&
+                     index.st_mtim.tv_nsec >= directory.st_mtim.tv_nsec));
+
+    if (indexed)
+    {
+        std::ifstream file(indexPath);
+        std::string name;
+        while (std::getline(file, name))
+        {
+            if (parseFinishedFileName(name, game))
+                finished.push_back(game);
+        }
+        return finished;
+    }
+
+    DIR *directoryList = opendir(path.c_str());
+    if (directoryList == nullptr)
+        return finished;
+
+    struct dirent *file;
+    while ((file = readdir(directoryList)) != nullptr)
+    {
+        if (parseFinishedFileName(file->d_name, game))
+            finished.push_back(game);
+    }
+    closedir(directoryList);
+
+    std::string content;
+    std::sort(finished.begin(), finished.end(), finishedBefore);
+    for (auto &finishedGame : finished)
+        content += finishedFileName(finishedGame) + "\n";
+    writeToFile(indexPath, content);
+    return finished;
+}
+
+bool GamedataManager::indexGame(std::string plid, FinishedGame game)
+{
+    std::lock_guard<std::mutex> lock(_gamesLock);
+
+    // games end in order, so this is almost always an append
+    std::vector<FinishedGame> &finished = finishedGames(plid);
+    auto position = std::upper_bound(finished.begin(), finished.end(), game, finishedBefore);
+    if (position != finished.begin() && !finishedBefore(*(position - 1), game))
+        return false;
+
+    finished.insert(position, game);
+    return true;
+}
+
+std::string GamedataManager::finishedGame(std::string plid, size_t k)
+{
+    std::lock_guard<std::mutex> lock(_gamesLock);
+
+    std::vector<FinishedGame> &finished = finishedGames(plid);
+    if (k >= finished.size())
+        return "";
+    return GAMES_DIR + playerDirectory(plid) + "/" + finishedFileName(finished[finished.size() - 1 - k]);
+}
+
+std::mutex &GamedataManager::playerLock(int plid)
+{
+    return _playerLocks[(size_t)plid % PLAYER_LOCK_STRIPES];
+}
+
+std::vector<std::unique_lock<std::mutex>> GamedataManager::lockForFork()
+{
+    // in the order they are nested in
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto &lock : _playerLocks)
+        locks.emplace_back(lock);
+    locks.emplace_back(_scoresLock);
+    locks.emplace_back(_gamesLock);
+    locks.push_back(_persistence.drain()); // and no file is being written
+    return locks;
+}
+
+bool GamedataManager::hasOngoingGame(std::string plid)
+{
+    try
+    {
+        validate_plid(plid);
+        // ongoing games are kept in memory, mirroring the GAMES directory
+        return findGame(plid) != nullptr;
     }
 
     catch (...)
@@ -158,10 +738,7 @@ bool GamedataManager::hasGames(std::string plid)
     try
     {
         validate_plid(plid);
-        // ongoing games are stored in the GAMES directory
-        std::string path = GAMES_DIR + plid;
-
-        return std::filesystem::is_directory(path);
+        return !finishedGame(plid, 0).empty();
     }
 
     catch (...)
@@ -177,32 +754,43 @@ bool GamedataManager::gameShouldEnd(std::string plid)
     return false;
 }
 
-void GamedataManager::gameOver(std::string plid, std::string code)
+void GamedataManager::gameOver(std::string plid, std::string code, int score)
 {
-    // create directory with plid and move file
-    // delete file from gamedata/games
-
-    std::string src_path = GAMES_DIR + gameFileName(plid);
-    std::string dest_path = GAMES_DIR + playerDirectory(plid);
+    Game game = ongoingGame(plid); // erased by the commit
+    time_t endTime = time(NULL);
 
-    std::string lastLine = currentDateTime() + " " + std::to_string(timeSinceStart(plid));
-    appendToFile(src_path, lastLine);
-
-    std::string newFilename = renameFile(code);
+    // the game's files are queued before a compaction can drop its End record
+    commit(endRecord(game, code, score, endTime), [&]()
+           { finishGame(game, code, score, endTime); });
+}
 
-    try
-    {
-        createDir(dest_path);
-        // Construct the destination path (folder + file name)
-        std::filesystem::path destPath = std::filesystem::path(dest_path) / newFilename;
+std::string GamedataManager::archivePath(const Game &game, std::string code, time_t endTime)
+{
+    return GAMES_DIR + playerDirectory(game._plid) + "/" + finishedFileName(FinishedGame{endTime, code[0]});
+}
 
-        // Move the file to the folder
-        std::filesystem::rename(src_path, destPath);
-    }
-    catch (std::exception &e)
+void GamedataManager::finishGame(const Game &game, std::string code, int score, time_t endTime)
+{
+    if (code == WIN_CODE)
+        makeScoreFile(game, score, endTime);
+
+    // same layout as the GAME_<PLID>.txt files of older versions
+    std::string content = game._plid + " " + game._mode + " " + game._key + " " +
+                          std::to_string(game._duration) + " " + game._dateTime + " " +
+                          std::to_string(game._startTime) + "\n";
+    for (auto &trial : game._trials)
     {
-        throw UnrecoverableError("Error moving file: " + src_path + " to " + dest_path);
+        content += "T: " + trial._key + " " + std::to_string(trial._nB) + " " +
+                   std::to_string(trial._nW) + " " + std::to_string(trial._time) + "\n";
     }
+    content += formatDateTime(endTime) + " " + std::to_string(endTime - game._startTime);
+
+    // the game file is written before its index entry, see finishedGames()
+    FinishedGame finished{endTime, code[0]};
+    _persistence.write(archivePath(game, code, endTime), content);
+    if (indexGame(game._plid, finished))
+        _persistence.append(GAMES_DIR + playerDirectory(game._plid) + "/" GAMES_INDEX,
+                            finishedFileName(finished) + "\n");
 }
 
 void GamedataManager::createGame(std::string plid, char mode, int duration,
@@ -211,15 +799,9 @@ void GamedataManager::createGame(std::string plid, char mode, int duration,
     validate_plid(plid);
     validate_playTime(duration);
 
-    std::string path = GAMES_DIR + gameFileName(plid);
-
     std::string code = generateRandomKey();
 
-    std::string content = plid + " " + mode + " " + code + " " +
-                          std::to_string(duration) + " " + dateTime + " " +
-                          std::to_string(time) + "\n";
-
-    writeToFile(path, content);
+    commit(startRecord(Game{plid, mode, code, duration, dateTime, time, {}}));
 }
 
 void GamedataManager::createGame(std::string plid, char mode, std::string key, int duration,
@@ -228,33 +810,12 @@ void GamedataManager::createGame(std::string plid, char mode, std::string key, i
     validate_plid(plid);
     validate_playTime(duration);
 
-    std::string path = GAMES_DIR + gameFileName(plid);
-
-    std::string content = plid + " " + mode + " " + key + " " +
-                          std::to_string(duration) + " " + dateTime + " " +
-                          std::to_string(time) + "\n";
-
-    writeToFile(path, content);
+    commit(startRecord(Game{plid, mode, key, duration, dateTime, time, {}}));
 }
 
 std::string GamedataManager::getsecretKey(std::string plid)
 {
-    std::string path = GAMES_DIR + gameFileName(plid);
-    std::string key;
-
-    // extract 3rd word from the file
-    std::fstream fileStream;
-    if (!openFile(fileStream, path, std::ios::in))
-    {
-        throw UnrecoverableError("Error opening file: " + path);
-    }
-
-    std::string line;
-    std::getline(fileStream, line);
-
-    key = getiword(line, 3);
-
-    return key;
+    return ongoingGame(plid)._key;
 }
 
 std::string GamedataManager::formatSecretKey(std::string key)
@@ -287,20 +848,9 @@ std::string GamedataManager::getiword(std::string line, int n)
 
 bool GamedataManager::isRepeatedTrial(std::string plid, std::string key)
 {
-    std::string path = GAMES_DIR + gameFileName(plid);
-    std::string line;
-
-    std::fstream fileStream;
-    if (!openFile(fileStream, path, std::ios::in))
-    {
-        throw UnrecoverableError("Error opening file: " + path);
-    }
-
-    std::getline(fileStream, line); // ignore first line
-    while (std::getline(fileStream, line))
+    for (auto &trial : ongoingGame(plid)._trials)
     {
-        std::string word = getiword(line, 2); // get second word
-        if (word == key)
+        if (trial._key == key)
         {
             return true;
         }
@@ -311,75 +861,23 @@ bool GamedataManager::isRepeatedTrial(std::string plid, std::string key)
 
 int GamedataManager::expectedNT(std::string PLID)
 {
-    std::string path = GAMES_DIR + gameFileName(PLID);
-    std::string line;
-
-    std::fstream fileStream;
-    if (!openFile(fileStream, path, std::ios::in))
-    {
-        throw UnrecoverableError("Error opening file: " + path);
-    }
-    int i = 0;
-    std::getline(fileStream, line); // ignore first line
-
-    while (std::getline(fileStream, line))
-    {
-        i++;
-    }
-    i++; // increment to get the expected number of trials
-
-    return i;
+    // increment to get the expected number of trials
+    return (int)ongoingGame(PLID)._trials.size() + 1;
 }
 
 long int GamedataManager::getOngoingGameTime(std::string plid)
 {
-    std::string path = GAMES_DIR + gameFileName(plid);
-    std::string line;
-
-    std::fstream fileStream;
-    if (!openFile(fileStream, path, std::ios::in))
-    {
-        throw UnrecoverableError("Error opening file: " + path);
-    }
-
-    std::getline(fileStream, line);
-    std::string word = getiword(line, 7); // get the time()
-
-    return std::stol(word);
+    return (long int)ongoingGame(plid)._startTime;
 }
 
 long int GamedataManager::getOngoingGameTimeLimit(std::string plid)
 {
-    std::string path = GAMES_DIR + gameFileName(plid);
-    std::string line;
-
-    std::fstream fileStream;
-    if (!openFile(fileStream, path, std::ios::in))
-    {
-        throw UnrecoverableError("Error opening file: " + path);
-    }
-
-    std::getline(fileStream, line);
-    std::string word = getiword(line, 4); // get the time()
-
-    return std::stol(word);
+    return ongoingGame(plid)._duration;
 }
 
 std::string GamedataManager::ongoingGameMode(std::string plid)
 {
-    std::string path = GAMES_DIR + gameFileName(plid);
-    std::string line;
-
-    std::fstream fileStream;
-    if (!openFile(fileStream, path, std::ios::in))
-    {
-        throw UnrecoverableError("Error opening file: " + path);
-    }
-
-    std::getline(fileStream, line);
-    std::string word = getiword(line, 2);
-
-    if (word == "P")
+    if (ongoingGame(plid)._mode == 'P')
     {
         return "PLAY";
     }
@@ -387,13 +885,10 @@ std::string GamedataManager::ongoingGameMode(std::string plid)
     {
         return "DEBUG";
     }
-
-    return word;
 }
 
 long int GamedataManager::timeSinceStart(std::string plid)
 {
-    std::string path = GAMES_DIR + gameFileName(plid);
     long int starttime = getOngoingGameTime(plid);
 
     time_t now = time(NULL);
@@ -403,35 +898,38 @@ long int GamedataManager::timeSinceStart(std::string plid)
 
 void GamedataManager::registerTry(std::string plid, std::string key, int B, int W)
 {
-    std::string path = GAMES_DIR + gameFileName(plid);
-    std::string content = "T: " + key + " " + std::to_string(B) + " " +
-                          std::to_string(W) + " " + std::to_string(timeSinceStart(plid)) + "\n";
-    appendToFile(path, content);
+    Game &game = ongoingGame(plid);
+    commit(tryRecord(game, Trial{key, B, W, timeSinceStart(plid)}));
 }
 
-void GamedataManager::makeScoreFile(std::string plid)
+void GamedataManager::makeScoreFile(const Game &game, int score, time_t endTime)
 {
-    // score PLID DDMMYYYY HHMMSS.txt
+    // SSS_PLID_YYYYMMDD_HHMMSS.txt
     // format: SSS, add zeros to the left
-    int nT = expectedNT(plid) - 1;
-    std::string score = std::to_string(rand() % 20 + (8 - nT) * 10); // better score with lower nT
-    while (score.length() < 3)
+    int nT = (int)game._trials.size();
+    std::string scoreString = std::to_string(score);
+    while (scoreString.length() < 3)
     {
-        score = "0" + score;
+        scoreString = "0" + scoreString;
     }
-    std::string timedate = currentDateTimeFN();
-    std::string filename = score + "_" + plid + "_" + timedate + ".txt";
+    std::string timedate = formatDateTimeFN(endTime);
+    std::string filename = scoreString + "_" + game._plid + "_" + timedate + ".txt";
 
     std::string path = SCORES_DIR + filename;
-    std::string content = score + " " + plid + " " + getsecretKey(plid) + " " + std::to_string(nT) + " " + ongoingGameMode(plid) + " " + "\n";
+    std::string mode = game._mode == 'P' ? "PLAY" : "DEBUG";
+    std::string content = scoreString + " " + game._plid + " " + game._key + " " + std::to_string(nT) + " " + mode + " " + "\n";
+
+    _persistence.write(path, content);
 
-    writeToFile(path, content);
+    addScore(ScoreEntry{filename, score, game._plid, game._key, nT,
+                        mode == "DEBUG" ? MODEDEBUG : MODEPLAY});
 }
 
 void GamedataManager::gameWon(std::string plid)
 {
-    makeScoreFile(plid);
-    gameOver(plid, WIN_CODE);
+    int nT = expectedNT(plid) - 1;
+    int score = rand() % 20 + (8 - nT) * 10; // better score with lower nT
+    gameOver(plid, WIN_CODE, score);
 }
 
 void GamedataManager::gameLost(std::string plid)
@@ -444,30 +942,69 @@ void GamedataManager::gameTimeout(std::string plid)
     gameOver(plid, TIMEOUT_CODE);
 }
 
+void GamedataManager::expireGames()
+{
+    std::vector<int> expired;
+    {
+        std::lock_guard<std::mutex> lock(_expiriesLock);
+        _expiries.advance(time(NULL), [&expired](int plid)
+                          { expired.push_back(plid); });
+    }
+
+    for (int plid : expired)
+    {
+        // the timer outlives its game: the player may have ended it, or
+        // started another one with a later deadline
+        std::lock_guard<std::mutex> lock(playerLock(plid));
+        std::string id = std::to_string(plid);
+        if (findGame(id) != nullptr && gameShouldEnd(id))
+            gameTimeout(id);
+    }
+}
+
 void GamedataManager::quitGame(std::string plid)
 {
     gameOver(plid, QUIT_CODE);
 }
 
-void GamedataManager::quitAllGames()
+void GamedataManager::prepareHandOver()
 {
-    std::string directory = GAMES_DIR;
+    // the journal is written through, only the game and score files are queued
+    _persistence.flush();
+
+    std::lock_guard<std::mutex> lock(_journalLock);
+    uint32_t journalSegment;
+    uint64_t journalSize;
+    _journal.position(journalSegment, journalSize);
+    std::lock_guard<std::mutex> scoresLock(_scoresLock);
+    _segment.markClean(journalSegment, journalSize, _topScores);
+}
 
-    std::regex pattern("^GAME_.*\\.txt$");
+void GamedataManager::resumeAfterHandOver()
+{
+    // the new process may have started over the segment before failing
+    std::lock_guard<std::mutex> lock(_journalLock);
+    _segment.reset();
+    for (auto &record : liveRecords())
+        _segment.apply(record);
+}
 
-    for (auto entry : std::filesystem::directory_iterator(directory))
+void GamedataManager::quitAllGames()
+{
+    std::vector<std::string> plids;
     {
-        if (entry.is_regular_file())
-        { // Check if it's a file
-            std::string fileName = entry.path().filename().string();
+        std::lock_guard<std::mutex> lock(_gamesLock);
+        _players.forEach([&plids](int, Player &player)
+                         {
+            if (player._game != nullptr)
+                plids.push_back(player._game->_plid); });
+    }
 
-            // Match the filename using the regular expression
-            if (std::regex_match(fileName, pattern))
-            {
-                std::string plid = fileName.substr(5, 6);
-                quitGame(plid);
-            }
-        }
+    for (auto &plid : plids)
+    {
+        std::lock_guard<std::mutex> lock(playerLock(std::stoi(plid)));
+        if (findGame(plid) != nullptr)
+            quitGame(plid);
     }
 }
 
@@ -521,55 +1058,65 @@ void GamedataManager::formatScoreboard(SCORELIST *list, std::string &fName,
 void GamedataManager::getCurrentGameData(std::string plid,
                                          std::string &fName, int &fSize, std::string &fdata)
 {
-    std::string path = GAMES_DIR + gameFileName(plid);
-
-    std::fstream fileStream;
-    if (!openFile(fileStream, path, std::ios::in))
-        throw UnrecoverableError("Error opening file");
+    Game &game = ongoingGame(plid);
 
     fName = gameFileName(plid);
 
-    int number_trials = countLinesInFile(fileStream) - 1;
+    std::string count = "\n\t--- Transactions found: " + std::to_string(game._trials.size()) + " ---\n\n";
+    std::string footer = "\n\t-- " + std::to_string(remainingTime(plid)) +
+                         " seconds remaining to be completed --\n";
 
-    std::string line;
-    std::getline(fileStream, line);
+    fdata.clear();
+    fdata.reserve(game._sheetHeader.size() + count.size() + game._sheetTrials.size() + footer.size() + 1);
+    fdata += game._sheetHeader;
+    fdata += count;
+    fdata += game._sheetTrials;
+    fdata += footer;
 
-    std::string game_duration = getiword(line, 4);
-    std::string dateTime = getiword(line, 5) + ' ' + getiword(line, 6);
+    fSize = (int)fdata.length();
 
-    fdata = "\n\tActive game found for player " + plid + '\n';
-    fdata += "Game initiated: " + dateTime + " with " + game_duration +
-             " seconds to be completed\n";
+    fdata += "\n";
+}
 
-    fdata += "\n\t--- Transactions found: " + std::to_string(number_trials) + " ---\n\n";
+int GamedataManager::getMostRecentGameFile(std::string plid, std::string &fName, int &fSize)
+{
+    std::string archive = finishedGame(plid, 0);
+    if (archive.empty())
+        throw UnrecoverableError("No finished game for player " + plid);
+    std::string sheet = SHEETS_DIR + plid + "_" + archive.substr(archive.rfind('/') + 1);
 
-    while (number_trials > 0)
+    int fd = open(sheet.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
     {
-        std::getline(fileStream, line);
-        std::string trial = getiword(line, 2);
-        std::string nB = getiword(line, 3);
-        std::string nW = getiword(line, 4);
-        std::string time = getiword(line, 5);
+        std::string fdata;
+        getMostRecentGameData(plid, fName, fSize, fdata);
+        replaceFile(sheet, fdata);
 
-        fdata += "Trial: " + trial + ", nB: " + nB + ", nW: " + nW +
-                 " at " + time + "s\n";
-
-        number_trials--;
+        fd = open(sheet.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            throw UnrecoverableError("Unable to open file: " + sheet, errno);
     }
 
-    fdata += "\n\t-- " + std::to_string(remainingTime(plid)) + " seconds remaining to be completed --\n";
-
-    fSize = (int)fdata.length();
+    struct stat info;
+    if (fstat(fd, &info) == -1 || info.st_size < 1)
+    {
+        close(fd);
+        throw UnrecoverableError("Unable to read file: " + sheet, errno);
+    }
 
-    fdata += "\n";
+    fName = gameFileName(plid);
+    fSize = (int)info.st_size - 1; // without the delimiter
+    return fd;
 }
 
 void GamedataManager::getMostRecentGameData(std::string plid, std::string &fName,
                                             int &fSize, std::string &fdata)
 {
 
-    std::string path;
-    findLastGame(plid, path);
+    std::string path = finishedGame(plid, 0);
+    if (path.empty())
+        throw UnrecoverableError("No finished game for player " + plid);
+    _persistence.flush(); // the game may still be being written to its directory
 
     std::fstream fileStream;
     if (!openFile(fileStream, path, std::ios::in))
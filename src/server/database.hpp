@@ -7,9 +7,19 @@
 #include <iostream>
 #include <ctime>
 #include <sys/stat.h>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <memory>
+#include <functional>
 
 #include "../common/utils.hpp"
 #include "../common/protocol.hpp"
+#include "persistence.hpp"
+#include "journal.hpp"
+#include "gamesegment.hpp"
+#include "timerwheel.hpp"
+#include "playertable.hpp"
 
 class DatabaseManager
 {
@@ -64,12 +74,14 @@ public:
     void writeToFile(std::string path, std::string content);
 
     /**
-     * @brief Renames the file at the specified path.
+     * @brief Replaces the file at the specified path by a new one with the given content.
      *
-     * @param path Path to the file to be renamed.
-     * @return std::string New path of the renamed file.
+     * The content is written to a temporary file that is then renamed over
+     * path, so a reader that already opened the file keeps its old content.
+     * @param path Path to the file.
+     * @param content Content of the new file.
      */
-    std::string renameFile(std::string path);
+    void replaceFile(std::string path, std::string content);
 
     /**
      * @brief Counts the number of lines in the given file stream.
@@ -80,8 +92,225 @@ public:
     int countLinesInFile(std::fstream &fileStream);
 };
 
+/**
+ * @struct Trial
+ * @brief A trial registered in an ongoing game.
+ */
+struct Trial
+{
+    std::string _key; // The guess, "CCCC"
+    int _nB;          // Number of correct positions
+    int _nW;          // Number of correct colors in wrong positions
+    long int _time;   // Seconds since the start of the game
+};
+
+/**
+ * @struct Game
+ * @brief An ongoing game, as rebuilt from the journal.
+ */
+struct Game
+{
+    std::string _plid;         // Player ID
+    char _mode;                // 'P' for play, 'D' for debug
+    std::string _key;          // Secret key, "CCCC"
+    int _duration;             // Time limit, in seconds
+    std::string _dateTime;     // Start date and time, "yyyy-mm-dd hh:mm:ss"
+    time_t _startTime;         // Start time, in seconds since the epoch
+    std::vector<Trial> _trials; // Trials made so far
+    std::string _sheetHeader{}; // STR body, up to the start time and limit
+    std::string _sheetTrials{}; // STR body, one line per trial
+};
+
+/**
+ * @struct FinishedGame
+ * @brief A finished game, as named in its player's directory.
+ */
+struct FinishedGame
+{
+    time_t _endTime; // When the game ended
+    char _code;      // WIN_CODE, FAIL_CODE, QUIT_CODE or TIMEOUT_CODE
+};
+
+/**
+ * @struct Player
+ * @brief What the server keeps in memory about a player.
+ */
+struct Player
+{
+    std::unique_ptr<Game> _game;          // Ongoing game, or nullptr
+    std::vector<FinishedGame> _finished; // Finished games, oldest first
+    bool _loaded = false;                // Whether _finished was read from GAMES_DIR
+};
+
+/**
+ * @struct ScoreEntry
+ * @brief A won game, as stored in its SCORES file.
+ */
+struct ScoreEntry
+{
+    std::string _fileName; // SSS_PLID_YYYYMMDD_HHMMSS.txt, which orders the scores
+    int _score;            // Score of the game
+    std::string _plid;     // Player ID
+    std::string _key;      // Secret key, "CCCC"
+    int _nT;               // Number of trials used
+    int _mode;             // MODEPLAY or MODEDEBUG
+};
+
 class GamedataManager : public DatabaseManager
 {
+private:
+    std::array<std::mutex, PLAYER_LOCK_STRIPES> _playerLocks; // Serialize each player's requests
+
+    PlayerTable<Player> _players; // Every player, by PLID
+    std::mutex _gamesLock;        // Protects the structure of _players
+
+    // Generation of every player's game, by PLID, see gameGeneration()
+    std::unique_ptr<std::atomic<uint32_t>[]> _generations;
+
+    /**
+     * @brief Finds the ongoing game of a player.
+     *
+     * The caller must hold the player's lock while using the returned game.
+     * @param plid Player ID.
+     * @return The game, or nullptr if the player has no ongoing game.
+     */
+    Game *findGame(std::string plid);
+
+    /**
+     * @brief Gets the ongoing game of a player.
+     *
+     * The caller must hold the player's lock while using the returned game.
+     * @param plid Player ID.
+     * @return The game.
+     * @throws UnrecoverableError if the player has no ongoing game.
+     */
+    Game &ongoingGame(std::string plid);
+
+    /**
+     * @brief Adds a newly created game to the ongoing games.
+     * @param game The game.
+     */
+    void insertGame(Game game);
+
+    /**
+     * @brief Removes the ongoing game of a player.
+     * @param plid Player ID.
+     */
+    void eraseGame(std::string plid);
+
+    /**
+     * @brief Gets the finished games of a player, loading them the first
+     * time, so the start does not depend on how many games were played.
+     *
+     * The games are read from the GAMES_INDEX file in the player's
+     * directory, unless a game file was added after the index was last
+     * written, in which case the directory is listed and the index rewritten.
+     * The caller must hold _gamesLock.
+     * @param plid Player ID.
+     */
+    std::vector<FinishedGame> &finishedGames(std::string plid);
+
+    /**
+     * @brief Adds a finished game to its player's index.
+     * @param plid Player ID.
+     * @param game The finished game.
+     * @return false if the game was already in the index.
+     */
+    bool indexGame(std::string plid, FinishedGame game);
+
+    TimerWheel _expiries;     // Deadline of every ongoing game, by PLID
+    std::mutex _expiriesLock; // Protects _expiries
+
+    GameJournal _journal;     // Every game event, from which the ongoing games are rebuilt
+    std::mutex _journalLock;  // Orders the appends with the changes to the games
+    GameSegment _segment;     // The ongoing games in shared memory, for the next process
+
+    /**
+     * @brief Appends a record to the journal and applies it to the ongoing games.
+     *
+     * The caller must hold the player's lock. Compacts the journal when its
+     * last segment is full.
+     * @param record The record.
+     * @param then Run once the record is applied, before any compaction.
+     */
+    void commit(const JournalRecord &record, const std::function<void()> &then = nullptr);
+
+    /**
+     * @brief Applies a record to the ongoing games, and to their shared
+     * memory segment.
+     * @param record The record.
+     */
+    void applyRecord(const JournalRecord &record);
+
+    /**
+     * @brief Rebuilds the ongoing games from the journal, and writes the
+     * files of the games that ended but were not archived yet.
+     */
+    void replayJournal();
+
+    /**
+     * @brief Replaces the journal with the records of the ongoing games.
+     *
+     * The caller must hold _journalLock.
+     */
+    void compactJournal();
+
+    /**
+     * @brief Gets a Start record per ongoing game, each followed by the Try
+     * records of its trials.
+     */
+    std::vector<JournalRecord> liveRecords();
+
+    /**
+     * @brief Moves the GAME_<PLID>.txt files left in GAMES_DIR by older
+     * versions of the server into the journal.
+     */
+    void loadGames();
+
+    /**
+     * @brief Gets the path of the file of a finished game, in its player's directory.
+     * @param game The game.
+     * @param code End game code.
+     * @param endTime When the game ended.
+     */
+    std::string archivePath(const Game &game, std::string code, time_t endTime);
+
+    /**
+     * @brief Writes the file of a finished game, and its score file if it was won.
+     * @param game The game.
+     * @param code End game code.
+     * @param score Score of the game, if it was won.
+     * @param endTime When the game ended.
+     */
+    void finishGame(const Game &game, std::string code, int score, time_t endTime);
+
+    std::vector<ScoreEntry> _topScores; // Best SCOREBOARD_SIZE scores, best first
+    std::string _scoreboardData;        // Formatted scoreboard of _topScores
+    int _scoreboardSize = 0;            // Size of the scoreboard, as sent
+    bool _scoreboardStale = true;       // Whether _topScores changed since formatted
+    std::mutex _scoresLock;             // Protects the scores and the scoreboard
+
+    /**
+     * @brief Loads the best scores from SCORES_DIR.
+     */
+    void loadScores();
+
+    /**
+     * @brief Adds a score, keeping only the best SCOREBOARD_SIZE.
+     * @param entry The score.
+     */
+    void addScore(ScoreEntry entry);
+
+    /**
+     * @brief Formats the scoreboard again if the scores changed.
+     *
+     * The caller must hold _scoresLock.
+     * @return The number of scores.
+     */
+    int refreshScoreboard();
+
+    PersistenceQueue _persistence; // Writes the game files in the background
+
 public:
     /**
      * @class GamedataManager
@@ -97,7 +326,71 @@ public:
     GamedataManager();
 
     /**
-     * @brief Checks if a player has a Game file for an ongoing game.
+     * @brief Gets the lock that serializes the requests of a player.
+     *
+     * Requests of the same player may be served concurrently by different
+     * workers, so handlers hold this lock while they check and update the
+     * player's game.
+     * @param plid Player ID.
+     * @return The lock shared by every player in the same stripe as plid.
+     */
+    std::mutex &playerLock(int plid);
+
+    /**
+     * @brief Selects when the game events are synced to disk.
+     *
+     * Must be called before serving any request.
+     * @param durability The durability mode.
+     * @param delay Commit window or sync interval, see GameJournal::setDurability.
+     */
+    void setDurability(Durability durability, std::chrono::microseconds delay);
+
+    /**
+     * @brief Selects how the game files are written, see PersistenceQueue.
+     */
+    void setIoEngine(IoEngine engine);
+
+    /**
+     * @brief Waits until the game events committed by this thread are durable.
+     *
+     * Servers call it before sending a reply, so that with
+     * Durability::GroupCommit no reply reports a change that could still be
+     * lost by a crash. Returns at once in the other modes.
+     */
+    void waitDurable();
+
+    /**
+     * @brief Gets the generation of a player's game, bumped whenever one of
+     * their games starts or ends.
+     *
+     * A reply given in one generation may no longer hold in the next, so
+     * the reply cache only answers a request from the same generation.
+     * @param plid Player ID, or -1 for a request without one.
+     */
+    uint32_t gameGeneration(int plid);
+
+    /**
+     * @brief Counts the generations bumped by this thread, ever, so that a
+     * server can tell whether a request changed its player's generation
+     * alone, or another thread changed it meanwhile.
+     */
+    static uint32_t ownGenerationBumps();
+
+    /**
+     * @brief Writes a line with the journal's sync statistics.
+     * @param out Where to write it.
+     */
+    void printStats(std::ostream &out);
+
+    /**
+     * @brief Takes every lock an STR or SSB request takes, so that a process
+     * forked meanwhile inherits none held by another thread.
+     * @return The held locks.
+     */
+    std::vector<std::unique_lock<std::mutex>> lockForFork();
+
+    /**
+     * @brief Checks if a player has an ongoing game.
      * @param plid Player ID.
      * @return True if the player has an ongoing game, false otherwise.
      */
@@ -144,17 +437,47 @@ public:
      */
     void quitGame(std::string plid);
 
+    /**
+     * @brief Gets the path of a finished game of a player.
+     * @param plid Player ID.
+     * @param k How many games later than it the player finished: 0 for the most recent.
+     * @return The path, or an empty string if the player did not finish that many games.
+     */
+    std::string finishedGame(std::string plid, size_t k);
+
     /**
      * @brief Quits all ongoing games.
      */
     void quitAllGames();
 
+    /**
+     * @brief Writes every queued file and marks the shared memory segment as
+     * up to date, so another process can take over the game data. Nothing
+     * may change the games afterwards.
+     */
+    void prepareHandOver();
+
+    /**
+     * @brief Rebuilds the shared memory segment from the ongoing games, once
+     * a hand over failed.
+     */
+    void resumeAfterHandOver();
+
+    /**
+     * @brief Ends, with gameTimeout(), every ongoing game past its time limit.
+     *
+     * Called periodically, so that abandoned games do not stay ongoing until
+     * their player sends another request.
+     */
+    void expireGames();
+
     /**
      * @brief Ends the game for a player with a specific code.
      * @param plid Player ID.
      * @param code End game code.
+     * @param score Score of the game, if it was won.
      */
-    void gameOver(std::string plid, std::string code);
+    void gameOver(std::string plid, std::string code, int score = 0);
 
     /**
      * @brief Gets the secret key for a player's game.
@@ -249,10 +572,12 @@ public:
     void gameTimeout(std::string plid);
 
     /**
-     * @brief Creates a score file from a finished game.
-     * @param plid Player ID.
+     * @brief Creates a score file from a won game.
+     * @param game The game.
+     * @param score Score of the game.
+     * @param endTime When the game ended.
      */
-    void makeScoreFile(std::string plid);
+    void makeScoreFile(const Game &game, int score, time_t endTime);
 
     /**
      * @brief Formats the scoreboard.
@@ -264,6 +589,28 @@ public:
      */
     void formatScoreboard(SCORELIST *list, std::string &fName, int &fSize, std::string &fdata, int nscores);
 
+    /**
+     * @brief Gets the formatted scoreboard of the best scores.
+     *
+     * The scores are kept in memory and the scoreboard is only formatted
+     * again when they change.
+     * @param fName File name.
+     * @param fSize File size.
+     * @param fdata File data.
+     * @return The number of scores, 0 if there are none.
+     */
+    int getScoreboard(std::string &fName, int &fSize, std::string &fdata);
+
+    /**
+     * @brief Opens the scoreboard, kept formatted in SHEETS_DIR.
+     * @param fName File name.
+     * @param fSize File size.
+     * @param fd Set to a file holding the fSize bytes of the scoreboard and
+     * the delimiter, to be closed by the caller, if there are scores.
+     * @return The number of scores, 0 if there are none.
+     */
+    int getScoreboardFile(std::string &fName, int &fSize, int &fd);
+
     /**
      * @brief Gets the remaining time for a player's game.
      * @param plid Player ID.
@@ -295,6 +642,19 @@ public:
      * @param fdata File data.
      */
     void getMostRecentGameData(std::string plid, std::string &fName, int &fSize, std::string &fdata);
+
+    /**
+     * @brief Opens the most recent game data for a player.
+     *
+     * Finished games never change, so the data of each one is rendered to
+     * SHEETS_DIR the first time it is requested and sent from there since.
+     * @param plid Player ID.
+     * @param fName File name.
+     * @param fSize File size.
+     * @return A file holding the fSize bytes of the data and the delimiter,
+     * to be closed by the caller.
+     */
+    int getMostRecentGameFile(std::string plid, std::string &fName, int &fSize);
 };
 
 #endif
\ No newline at end of file
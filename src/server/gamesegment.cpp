@@ -0,0 +1,276 @@
+#include "gamesegment.hpp"
+#include "database.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define GAME_SEGMENT_MAGIC 0x47534753 // "GSGS"
+#define GAME_SEGMENT_VERSION 2
+
+GameSegment::~GameSegment()
+{
+    if (_header != nullptr)
+        munmap(_header, _size);
+    if (_fd != -1)
+        close(_fd);
+}
+
+/**
+ * @brief FNV-1a of everything after the checksum, the first field of both
+ * slots and scores.
+ */
+static uint32_t fnv1a(const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data + sizeof(uint32_t);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size - sizeof(uint32_t); i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+uint32_t GameSegment::checksum(const Slot &slot)
+{
+    return fnv1a(&slot, sizeof(slot));
+}
+
+uint32_t GameSegment::checksum(const Score &score)
+{
+    return fnv1a(&score, sizeof(score));
+}
+
+void GameSegment::open(std::string dataDir)
+{
+    // one segment per game data directory
+    char path[PATH_MAX];
+    if (realpath(dataDir.c_str(), path) == nullptr)
+        return;
+    char name[64];
+    snprintf(name, sizeof(name), GAME_SEGMENT_PREFIX "%016zx", std::hash<std::string>()(path));
+
+    _fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (_fd == -1)
+    {
+        std::cerr << "Error: shm_open " << name << ": " << strerror(errno)
+                  << ", the games are not kept across restarts" << std::endl;
+        return;
+    }
+
+    // a segment of another size is from another layout: start it over
+    static_assert((sizeof(Header) + SCOREBOARD_SIZE * sizeof(Score)) % alignof(Slot) == 0,
+                  "the table must be aligned");
+    _size = sizeof(Header) + SCOREBOARD_SIZE * sizeof(Score) + GAME_SEGMENT_SLOTS * sizeof(Slot);
+    struct stat info;
+    if (fstat(_fd, &info) == -1 ||
+        ((size_t)info.st_size != _size && (ftruncate(_fd, 0) == -1 || ftruncate(_fd, (off_t)_size) == -1)))
+    {
+        std::cerr << "Error: sizing " << name << ": " << strerror(errno) << std::endl;
+        return;
+    }
+
+    void *base = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (base == MAP_FAILED)
+    {
+        std::cerr << "Error: mmap " << name << ": " << strerror(errno) << std::endl;
+        return;
+    }
+    _header = (Header *)base;
+    _scores = (Score *)(_header + 1);
+    _table = (Slot *)(_scores + SCOREBOARD_SIZE);
+}
+
+bool GameSegment::load(uint32_t journalSegment, uint64_t journalSize, std::vector<JournalRecord> &records)
+{
+    if (_header == nullptr || _header->_magic != GAME_SEGMENT_MAGIC ||
+        _header->_version != GAME_SEGMENT_VERSION || _header->_slots != GAME_SEGMENT_SLOTS ||
+        _header->_slotSize != sizeof(Slot) || _header->_clean != 1 ||
+        _header->_journalSegment != journalSegment || _header->_journalSize != journalSize)
+        return false;
+
+    std::unordered_map<uint32_t, bool> seen;
+    for (uint32_t i = 0; i < GAME_SEGMENT_SLOTS; i++)
+    {
+        const Slot &slot = _table[i];
+        if (!slot._used)
+            continue;
+        if (slot._checksum != checksum(slot) || slot._plid >= PLID_COUNT ||
+            slot._nTrials > MAX_TRIALS || !seen.emplace(slot._plid, true).second)
+        {
+            records.clear();
+            return false;
+        }
+
+        JournalRecord start{};
+        start._type = JournalRecord::Start;
+        start._plid = slot._plid;
+        start._time = slot._startTime;
+        start._mode = slot._mode;
+        start._duration = slot._duration;
+        memcpy(start._key, slot._key, KEY_SIZE);
+        records.push_back(start);
+
+        for (uint32_t t = 0; t < slot._nTrials; t++)
+        {
+            JournalRecord trial{};
+            trial._type = JournalRecord::Try;
+            trial._plid = slot._plid;
+            trial._time = slot._trials[t]._time;
+            trial._nB = slot._trials[t]._nB;
+            trial._nW = slot._trials[t]._nW;
+            memcpy(trial._key, slot._trials[t]._key, KEY_SIZE);
+            records.push_back(trial);
+        }
+    }
+    return true;
+}
+
+bool GameSegment::loadScores(std::vector<ScoreEntry> &scores)
+{
+    scores.clear();
+    if (_header == nullptr || _header->_scores > SCOREBOARD_SIZE)
+        return false;
+
+    for (uint32_t i = 0; i < _header->_scores; i++)
+    {
+        const Score &score = _scores[i];
+        if (score._checksum != checksum(score) || score._fileName[SCORE_NAME_SIZE - 1] != '\0')
+        {
+            scores.clear();
+            return false;
+        }
+
+        ScoreEntry entry;
+        entry._fileName = score._fileName;
+        entry._score = score._score;
+        entry._plid = std::string(score._plid, strnlen(score._plid, PLID_MAX_SIZE));
+        entry._key = std::string(score._key, KEY_SIZE);
+        entry._nT = score._nT;
+        entry._mode = score._mode;
+        scores.push_back(entry);
+    }
+    return true;
+}
+
+void GameSegment::reset()
+{
+    _slotOf.clear();
+    _free.clear();
+    _overflowed = false;
+    if (_header == nullptr)
+        return;
+
+    memset((void *)_header, 0, _size);
+    _header->_magic = GAME_SEGMENT_MAGIC;
+    _header->_version = GAME_SEGMENT_VERSION;
+    _header->_slots = GAME_SEGMENT_SLOTS;
+    _header->_slotSize = sizeof(Slot);
+
+    // handed out from the start of the table
+    for (uint32_t i = GAME_SEGMENT_SLOTS; i > 0; i--)
+        _free.push_back(i - 1);
+}
+
+void GameSegment::apply(const JournalRecord &record)
+{
+    if (_header == nullptr)
+        return;
+
+    auto found = _slotOf.find(record._plid);
+    switch (record._type)
+    {
+    case JournalRecord::Start:
+    {
+        uint32_t index;
+        if (found != _slotOf.end())
+            index = found->second;
+        else if (!_free.empty())
+        {
+            index = _free.back();
+            _free.pop_back();
+            _slotOf[record._plid] = index;
+        }
+        else
+        {
+            _overflowed = true; // more ongoing games than slots
+            return;
+        }
+
+        Slot &slot = _table[index];
+        memset((void *)&slot, 0, sizeof(slot));
+        slot._plid = record._plid;
+        slot._startTime = record._time;
+        slot._duration = record._duration;
+        slot._mode = record._mode;
+        slot._used = 1;
+        memcpy(slot._key, record._key, KEY_SIZE);
+        slot._checksum = checksum(slot);
+        break;
+    }
+    case JournalRecord::Try:
+    {
+        if (found == _slotOf.end())
+            return;
+        Slot &slot = _table[found->second];
+        if (slot._nTrials == MAX_TRIALS)
+            return;
+
+        Trial &trial = slot._trials[slot._nTrials++];
+        trial._time = record._time;
+        trial._nB = record._nB;
+        trial._nW = record._nW;
+        memcpy(trial._key, record._key, KEY_SIZE);
+        slot._checksum = checksum(slot);
+        break;
+    }
+    case JournalRecord::End:
+    {
+        if (found == _slotOf.end())
+            return;
+        memset((void *)&_table[found->second], 0, sizeof(Slot));
+        _free.push_back(found->second);
+        _slotOf.erase(found);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void GameSegment::markClean(uint32_t journalSegment, uint64_t journalSize,
+                            const std::vector<ScoreEntry> &scores)
+{
+    if (_header == nullptr || _overflowed)
+        return;
+
+    _header->_scores = 0;
+    for (auto &entry : scores)
+    {
+        // a score that does not fit leaves the segment unmarked
+        if (_header->_scores == SCOREBOARD_SIZE || entry._fileName.size() >= SCORE_NAME_SIZE ||
+            entry._plid.size() > PLID_MAX_SIZE || entry._key.size() != KEY_SIZE)
+            return;
+
+        Score &score = _scores[_header->_scores++];
+        memset((void *)&score, 0, sizeof(score));
+        score._score = entry._score;
+        score._nT = entry._nT;
+        score._mode = entry._mode;
+        memcpy(score._plid, entry._plid.data(), entry._plid.size());
+        memcpy(score._key, entry._key.data(), KEY_SIZE);
+        memcpy(score._fileName, entry._fileName.data(), entry._fileName.size());
+        score._checksum = checksum(score);
+    }
+
+    _header->_journalSegment = journalSegment;
+    _header->_journalSize = journalSize;
+    // the table and the position are complete before the mark
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->_clean = 1;
+}
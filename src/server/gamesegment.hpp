@@ -0,0 +1,144 @@
+#ifndef GAMESEGMENT_H
+#define GAMESEGMENT_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../common/constants.hpp"
+#include "journal.hpp"
+
+struct ScoreEntry;
+
+/**
+ * @class GameSegment
+ * @brief The ongoing games, mirrored in a named shared memory segment so
+ * that the next process can start from them.
+ *
+ * The segment holds a header, the best scores, and a table of
+ * GAME_SEGMENT_SLOTS fixed-size slots, one per ongoing game, each with its
+ * trials and a checksum. Every record applied to the games is applied to the
+ * table too, under the same lock, while the scores are only written when the
+ * segment is marked.
+ *
+ * The table is only trusted if the process that left it marked it as
+ * matching the journal, at a clean shutdown or a hot upgrade, once the
+ * queued game files were written. A crash leaves it unmarked, and the next
+ * process rebuilds the games from the journal, which also writes the files
+ * the crash may have lost.
+ */
+class GameSegment
+{
+private:
+    struct Header
+    {
+        uint32_t _magic;          // GAME_SEGMENT_MAGIC
+        uint32_t _version;        // GAME_SEGMENT_VERSION, bumped when the layout changes
+        uint32_t _slots;          // Number of slots in the table
+        uint32_t _slotSize;       // sizeof(Slot)
+        uint32_t _clean;          // 1 if the table matches the journal position below
+        uint32_t _journalSegment; // Last journal segment when marked
+        uint64_t _journalSize;    // Its size, in bytes, when marked
+        uint32_t _scores;         // Best scores kept, up to SCOREBOARD_SIZE
+        uint32_t _reserved;       // Zero, aligns the scores
+    };
+
+    static const size_t SCORE_NAME_SIZE = 32; // SSS_PLID_YYYYMMDD_HHMMSS.txt and its NUL
+
+    struct Score
+    {
+        uint32_t _checksum; // Of the rest of the score
+        int32_t _score;
+        int32_t _nT;
+        int32_t _mode;
+        char _plid[PLID_MAX_SIZE]; // Padded with NULs
+        char _key[KEY_SIZE];
+        char _fileName[SCORE_NAME_SIZE];
+        uint8_t _reserved[2]; // Zero, aligns the table
+    };
+
+    struct Trial
+    {
+        int64_t _time; // When the trial was made, in seconds since the epoch
+        char _key[KEY_SIZE];
+        uint8_t _nB;
+        uint8_t _nW;
+        uint8_t _reserved[2];
+    };
+
+    struct Slot
+    {
+        uint32_t _checksum; // Of the rest of the slot
+        uint32_t _plid;
+        int64_t _startTime;
+        uint16_t _duration;
+        char _mode;
+        uint8_t _used;
+        char _key[KEY_SIZE];
+        uint32_t _nTrials;
+        uint32_t _reserved; // Zero, aligns the trials
+        Trial _trials[MAX_TRIALS];
+    };
+
+    int _fd = -1;
+    size_t _size = 0;
+    Header *_header = nullptr; // nullptr if the segment is unavailable
+    Score *_scores = nullptr;
+    Slot *_table = nullptr;
+    std::unordered_map<uint32_t, uint32_t> _slotOf; // Slot of each ongoing game, by PLID
+    std::vector<uint32_t> _free;                    // Slots not in use
+    bool _overflowed = false; // Whether a game did not fit, so the table is incomplete
+
+    static uint32_t checksum(const Slot &slot);
+    static uint32_t checksum(const Score &score);
+
+public:
+    GameSegment() = default;
+    GameSegment(const GameSegment &) = delete;
+    GameSegment &operator=(const GameSegment &) = delete;
+    ~GameSegment();
+
+    /**
+     * @brief Opens, or creates, the segment of the game data in dataDir.
+     * On failure the games are simply not mirrored.
+     */
+    void open(std::string dataDir);
+
+    /**
+     * @brief Reads the ongoing games, if the table can be trusted.
+     * @param journalSegment The last segment of the journal.
+     * @param journalSize Its size, in bytes.
+     * @param records Filled with a Start record per game, each followed by
+     * the Try records of its trials.
+     * @return false if the segment is missing, was left by a crash, does
+     * not match the journal or fails validation.
+     */
+    bool load(uint32_t journalSegment, uint64_t journalSize, std::vector<JournalRecord> &records);
+
+    /**
+     * @brief Reads the best scores, once load() trusted the segment.
+     * @param scores Filled with the scores, best first.
+     * @return false if a score fails validation.
+     */
+    bool loadScores(std::vector<ScoreEntry> &scores);
+
+    /**
+     * @brief Empties the table, which stops matching the journal until marked.
+     */
+    void reset();
+
+    /**
+     * @brief Applies a record to the table.
+     */
+    void apply(const JournalRecord &record);
+
+    /**
+     * @brief Stores the best scores and marks the table as matching the
+     * journal at the given position. Nothing may be applied afterwards.
+     * @param scores The best scores, best first, up to SCOREBOARD_SIZE.
+     */
+    void markClean(uint32_t journalSegment, uint64_t journalSize, const std::vector<ScoreEntry> &scores);
+};
+
+#endif
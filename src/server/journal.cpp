@@ -0,0 +1,349 @@
+#include "journal.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// segments are named journal_NNNNNN.log
+#define SEGMENT_PREFIX "journal_"
+#define SEGMENT_SUFFIX ".log"
+
+GameJournal::GameJournal(std::string dir) : _dir(dir), _segment(0), _size(0)
+{
+}
+
+GameJournal::~GameJournal()
+{
+    if (_syncer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_syncLock);
+            _stopping = true;
+        }
+        _syncNeeded.notify_one();
+        _syncer.join();
+    }
+
+    if (_fd != -1)
+        close(_fd);
+}
+
+void GameJournal::setDurability(Durability durability, std::chrono::microseconds delay)
+{
+    _durability = durability;
+    _syncDelay = delay;
+
+    if (_durability != Durability::None)
+        _syncer = std::thread(&GameJournal::runSyncer, this);
+}
+
+uint32_t GameJournal::checksum(const JournalRecord &record)
+{
+    static uint32_t table[256];
+    static bool initialized = []
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++)
+                crc = crc & 1 ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+            table[i] = crc;
+        }
+        return true;
+    }();
+    (void)initialized;
+
+    // everything after the checksum itself
+    const uint8_t *bytes = (const uint8_t *)&record + sizeof(record._checksum);
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < sizeof(record) - sizeof(record._checksum); i++)
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+std::string GameJournal::segmentPath(uint32_t segment)
+{
+    char name[32];
+    snprintf(name, sizeof(name), SEGMENT_PREFIX "%06u" SEGMENT_SUFFIX, segment);
+    return _dir + name;
+}
+
+std::vector<uint32_t> GameJournal::listSegments()
+{
+    std::vector<uint32_t> segments;
+
+    DIR *dir = opendir(_dir.c_str());
+    if (dir == nullptr)
+        throw UnrecoverableError("Unable to open directory: " + _dir, errno);
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        unsigned int segment;
+        char suffix[8];
+        // the suffix must match exactly, so temporary files are skipped
+        if (sscanf(entry->d_name, SEGMENT_PREFIX "%6u%7s", &segment, suffix) == 2 &&
+            strcmp(suffix, SEGMENT_SUFFIX) == 0)
+            segments.push_back(segment);
+    }
+    closedir(dir);
+
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+void GameJournal::openSegment(uint32_t segment)
+{
+    std::string path = segmentPath(segment);
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (fd == -1)
+        throw UnrecoverableError("Unable to open journal segment: " + path, errno);
+
+    struct stat info;
+    if (fstat(fd, &info) == -1)
+    {
+        close(fd);
+        throw UnrecoverableError("Unable to open journal segment: " + path, errno);
+    }
+
+    std::lock_guard<std::mutex> lock(_syncLock); // the syncer may be using _fd
+    if (_fd != -1)
+        close(_fd);
+    _fd = fd;
+    _segment = segment;
+    _size = (size_t)info.st_size;
+}
+
+void GameJournal::replay(const std::function<void(const JournalRecord &)> &apply)
+{
+    if (mkdir(_dir.c_str(), 0777) == -1 && errno != EEXIST)
+        throw UnrecoverableError("Unable to create directory: " + _dir, errno);
+
+    std::vector<uint32_t> segments = listSegments();
+
+    for (uint32_t segment : segments)
+    {
+        std::string path = segmentPath(segment);
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == nullptr)
+            throw UnrecoverableError("Unable to open journal segment: " + path, errno);
+
+        JournalRecord record;
+        long valid = 0; // bytes up to the last valid record
+        while (fread(&record, sizeof(record), 1, file) == 1)
+        {
+            if (record._checksum != checksum(record))
+                break;
+            apply(record);
+            valid += (long)sizeof(record);
+        }
+
+        bool torn = ftell(file) != valid || !feof(file);
+        fclose(file);
+
+        if (torn)
+        {
+            std::cerr << "Discarding the end of the journal segment " << path
+                      << " after " << valid << " bytes" << std::endl;
+            // only the last segment can be appended to again
+            if (segment == segments.back() && truncate(path.c_str(), valid) == -1)
+                throw UnrecoverableError("Unable to truncate journal segment: " + path, errno);
+        }
+    }
+
+    openSegment(segments.empty() ? 0 : segments.back());
+}
+
+void GameJournal::resume()
+{
+    if (mkdir(_dir.c_str(), 0777) == -1 && errno != EEXIST)
+        throw UnrecoverableError("Unable to create directory: " + _dir, errno);
+
+    std::vector<uint32_t> segments = listSegments();
+    openSegment(segments.empty() ? 0 : segments.back());
+}
+
+void GameJournal::position(uint32_t &segment, uint64_t &size)
+{
+    segment = _segment;
+    size = _size;
+}
+
+uint64_t GameJournal::append(JournalRecord record)
+{
+    record._checksum = checksum(record);
+
+    // O_APPEND and a single small write: the record is never interleaved
+    ssize_t n;
+    do
+        n = write(_fd, &record, sizeof(record));
+    while (n == -1 && errno == EINTR);
+
+    if (n != (ssize_t)sizeof(record))
+        throw UnrecoverableError("Unable to append to journal segment: " + segmentPath(_segment), errno);
+
+    _size += sizeof(record);
+
+    std::lock_guard<std::mutex> lock(_syncLock);
+    if (_appended == _durable)
+        _oldestPending = std::chrono::steady_clock::now();
+    uint64_t sequence = ++_appended;
+
+    if (_durability == Durability::GroupCommit)
+        _syncNeeded.notify_one();
+    return sequence;
+}
+
+void GameJournal::waitDurable(uint64_t sequence)
+{
+    if (_durability != Durability::GroupCommit)
+        return;
+
+    std::unique_lock<std::mutex> lock(_syncLock);
+    _synced.wait(lock, [this, sequence]
+                 { return _durable >= sequence || _stopping; });
+}
+
+JournalStats GameJournal::stats()
+{
+    std::lock_guard<std::mutex> lock(_syncLock);
+    return _stats;
+}
+
+void GameJournal::markDurable(uint64_t target, std::chrono::steady_clock::time_point oldest)
+{
+    if (target <= _durable)
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    uint64_t latency = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(now - oldest).count();
+
+    _stats._syncs++;
+    _stats._syncedRecords += target - _durable;
+    _stats._latencyTotalUs += latency;
+    _stats._latencyMaxUs = std::max(_stats._latencyMaxUs, latency);
+
+    _durable = target;
+    _synced.notify_all();
+}
+
+void GameJournal::runSyncer()
+{
+    std::unique_lock<std::mutex> lock(_syncLock);
+
+    while (true)
+    {
+        if (_durability == Durability::GroupCommit)
+        {
+            _syncNeeded.wait(lock, [this]
+                             { return _appended > _durable || _stopping; });
+
+            // let the batch gather more records, within the commit window
+            // of its oldest one
+            _syncNeeded.wait_until(lock, _oldestPending + _syncDelay, [this]
+                                   { return _stopping; });
+        }
+        else
+        {
+            _syncNeeded.wait_for(lock, _syncDelay, [this]
+                                 { return _stopping; });
+        }
+
+        if (_appended == _durable)
+        {
+            if (_stopping)
+                break;
+            continue;
+        }
+
+        uint64_t target = _appended;
+        auto oldest = _oldestPending;
+        auto start = std::chrono::steady_clock::now();
+        // a duplicate stays valid even if a compaction replaces _fd meanwhile
+        int fd = dup(_fd);
+        lock.unlock();
+
+        if (fd == -1 || fdatasync(fd) == -1)
+            std::cerr << "Error: syncing the journal: " << strerror(errno) << std::endl;
+        if (fd != -1)
+            close(fd);
+
+        lock.lock();
+        markDurable(target, oldest);
+        // records appended during the sync have waited since it started, at most
+        if (_appended > _durable)
+            _oldestPending = start;
+    }
+}
+
+bool GameJournal::full() const
+{
+    return _size >= JOURNAL_SEGMENT_SIZE;
+}
+
+void GameJournal::compact(const std::vector<JournalRecord> &live)
+{
+    std::vector<uint32_t> segments = listSegments();
+    uint32_t next = _segment + 1;
+    std::string path = segmentPath(next);
+    std::string temporary = path + ".tmp";
+
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd == -1)
+        throw UnrecoverableError("Unable to create journal segment: " + temporary, errno);
+
+    std::vector<JournalRecord> records(live);
+    for (JournalRecord &record : records)
+        record._checksum = checksum(record);
+
+    const char *data = (const char *)records.data();
+    size_t size = records.size() * sizeof(JournalRecord), written = 0;
+    while (written < size)
+    {
+        ssize_t n = write(fd, data + written, size - written);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+        {
+            close(fd);
+            unlink(temporary.c_str());
+            throw UnrecoverableError("Unable to write journal segment: " + temporary, errno);
+        }
+        written += (size_t)n;
+    }
+
+    // the old segments are only removed once the new one is safely on disk
+    bool synced = fdatasync(fd) == 0;
+    if (close(fd) == -1 || !synced || rename(temporary.c_str(), path.c_str()) == -1)
+    {
+        unlink(temporary.c_str());
+        throw UnrecoverableError("Unable to write journal segment: " + path, errno);
+    }
+
+    // and so is its name, or the rename could be lost while the unlinks persist
+    int dirFd = open(_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd == -1)
+        throw UnrecoverableError("Unable to open directory: " + _dir, errno);
+    synced = fsync(dirFd) == 0;
+    int error = errno;
+    close(dirFd);
+    if (!synced)
+        throw UnrecoverableError("Unable to sync directory: " + _dir, error);
+
+    openSegment(next);
+    {
+        // the new segment holds everything appended so far, and was synced
+        std::lock_guard<std::mutex> lock(_syncLock);
+        markDurable(_appended, _oldestPending);
+    }
+    for (uint32_t segment : segments)
+    {
+        if (segment < next)
+            unlink(segmentPath(segment).c_str());
+    }
+}
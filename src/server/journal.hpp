@@ -0,0 +1,204 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/constants.hpp"
+#include "../common/utils.hpp"
+
+/**
+ * @struct JournalRecord
+ * @brief A game event, as stored in the journal.
+ *
+ * Every record has the same fixed layout, without padding, so the journal
+ * can be read back without parsing and a torn write is detected by its
+ * checksum. Records should be value-initialized, so unused fields are zero.
+ */
+struct JournalRecord
+{
+    enum Type : uint8_t
+    {
+        Start = 1, // A game started (SNG or DBG)
+        Try = 2,   // A trial was registered
+        End = 3    // The game ended, for the reason in _code
+    };
+
+    uint32_t _checksum;   // CRC-32 of the rest of the record
+    uint32_t _plid;       // Player ID
+    int64_t _time;        // When the event happened, in seconds since the epoch
+    uint16_t _duration;   // Start: time limit, in seconds
+    uint16_t _score;      // End: score of a won game
+    uint8_t _type;        // One of Type
+    char _mode;           // Start: 'P' for play, 'D' for debug
+    char _code;           // End: WIN_CODE, FAIL_CODE, QUIT_CODE or TIMEOUT_CODE
+    uint8_t _nB;          // Try: number of correct positions
+    uint8_t _nW;          // Try: number of correct colors in wrong positions
+    char _key[KEY_SIZE];  // Start: secret key, Try: guess
+    uint8_t _reserved[3]; // Zero
+};
+
+static_assert(sizeof(JournalRecord) == JOURNAL_RECORD_SIZE, "Journal records must keep their layout");
+
+/**
+ * @brief When the appended records are synced to disk.
+ */
+enum class Durability
+{
+    None,       // never: the kernel writes them back whenever it wants
+    Periodic,   // every sync interval, without holding the replies
+    GroupCommit // in batches, each reply waiting for the batch of its records
+};
+
+/**
+ * @struct JournalStats
+ * @brief How the journal has been synced since startup.
+ */
+struct JournalStats
+{
+    uint64_t _syncs = 0;          // Number of fdatasync calls
+    uint64_t _syncedRecords = 0;  // Records made durable by them
+    uint64_t _latencyTotalUs = 0; // Sum, over the syncs, of how long their oldest record waited
+    uint64_t _latencyMaxUs = 0;   // Longest wait of a record
+};
+
+/**
+ * @class GameJournal
+ * @brief Append-only log of every game event, split in numbered segments.
+ *
+ * The ongoing games are rebuilt on startup by replaying the segments in
+ * order. Once the last segment grows past JOURNAL_SEGMENT_SIZE, compact()
+ * replaces every segment with a new one holding only the ongoing games.
+ */
+class GameJournal
+{
+private:
+    std::string _dir;    // Directory of the segments
+    int _fd = -1;        // The segment being appended to
+    uint32_t _segment;   // Number of that segment
+    size_t _size;        // Size of that segment, in bytes
+
+    Durability _durability = Durability::None;
+    std::chrono::microseconds _syncDelay; // Commit window, or sync interval
+    std::mutex _syncLock;                 // Protects _fd and the fields below
+    std::condition_variable _syncNeeded;  // Signalled when records are appended
+    std::condition_variable _synced;      // Signalled when records become durable
+    uint64_t _appended = 0;               // Records appended since startup
+    uint64_t _durable = 0;                // How many of them are known to be on disk
+    std::chrono::steady_clock::time_point _oldestPending; // When the oldest record not on disk was appended
+    bool _stopping = false;               // Whether the syncer should exit
+    std::thread _syncer;                  // Syncs the records, unless Durability::None
+    JournalStats _stats;
+
+    /**
+     * @brief Marks the records up to target as durable, updating the stats.
+     *
+     * The caller must hold _syncLock.
+     */
+    void markDurable(uint64_t target, std::chrono::steady_clock::time_point oldest);
+
+    void runSyncer();
+
+    std::string segmentPath(uint32_t segment);
+
+    /**
+     * @brief Lists the numbers of the segments in the directory, in order.
+     */
+    std::vector<uint32_t> listSegments();
+
+    void openSegment(uint32_t segment);
+
+public:
+    /**
+     * @brief Prepares the journal kept in dir.
+     *
+     * Nothing can be appended until replay() is called.
+     */
+    GameJournal(std::string dir);
+
+    /**
+     * @brief Syncs the pending records, unless Durability::None, and closes the journal.
+     */
+    ~GameJournal();
+
+    /**
+     * @brief Selects when the records are synced to disk, starting the syncer if needed.
+     *
+     * Must be called at most once, before any record is appended.
+     * @param durability The durability mode.
+     * @param delay GroupCommit: how long a batch may wait for more records
+     * after its first one. Periodic: time between syncs.
+     */
+    void setDurability(Durability durability, std::chrono::microseconds delay);
+
+    /**
+     * @brief Computes the checksum of a record.
+     */
+    static uint32_t checksum(const JournalRecord &record);
+
+    /**
+     * @brief Reads every segment in order, calling apply for each valid record.
+     *
+     * Reading a segment stops at the first record whose checksum does not
+     * match, and the last segment is truncated there, so a write torn by a
+     * crash is discarded. The last segment is then opened for appending,
+     * and the directory is created if needed.
+     */
+    void replay(const std::function<void(const JournalRecord &)> &apply);
+
+    /**
+     * @brief Opens the last segment for appending without reading it, for
+     * when the ongoing games are known from elsewhere. replay() may still be
+     * called afterwards.
+     */
+    void resume();
+
+    /**
+     * @brief Gets where the next record will be appended.
+     * @param segment Set to the number of the last segment.
+     * @param size Set to its size, in bytes.
+     */
+    void position(uint32_t &segment, uint64_t &size);
+
+    /**
+     * @brief Appends a record, filling in its checksum.
+     * @return The sequence number of the record, for waitDurable().
+     * @throws UnrecoverableError if the record could not be written.
+     */
+    uint64_t append(JournalRecord record);
+
+    /**
+     * @brief With Durability::GroupCommit, waits until the record with the
+     * given sequence number, and every one before it, is on disk.
+     */
+    void waitDurable(uint64_t sequence);
+
+    /**
+     * @brief Gets how the journal has been synced since startup.
+     */
+    JournalStats stats();
+
+    /**
+     * @brief Checks if the last segment should be compacted.
+     */
+    bool full() const;
+
+    /**
+     * @brief Replaces every segment with a new one holding only the given records.
+     *
+     * The new segment is written and synced under a temporary name before
+     * it replaces the others, so a crash leaves either the old segments or
+     * the new one.
+     * @param live The records of the ongoing games.
+     */
+    void compact(const std::vector<JournalRecord> &live);
+};
+
+#endif
@@ -0,0 +1,289 @@
+#include "persistence.hpp"
+#include "database.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+PersistenceQueue::PersistenceQueue(DatabaseManager &files) : _files(files)
+{
+    _writer = std::thread(&PersistenceQueue::run, this);
+}
+
+PersistenceQueue::~PersistenceQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _stopping = true;
+    }
+    _pending.notify_one();
+    _writer.join();
+}
+
+void PersistenceQueue::push(FileOperation::Type type, std::string path, std::string content)
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _operations.push_back(FileOperation{type, std::move(path), std::move(content)});
+    }
+    _pending.notify_one();
+}
+
+void PersistenceQueue::write(std::string path, std::string content)
+{
+    push(FileOperation::Write, path, content);
+}
+
+void PersistenceQueue::append(std::string path, std::string content)
+{
+    push(FileOperation::Append, path, content);
+}
+
+void PersistenceQueue::setEngine(IoEngine engine)
+{
+    _batched = engine == IoEngine::Uring;
+}
+
+void PersistenceQueue::flush()
+{
+    std::unique_lock<std::mutex> lock = drain();
+}
+
+/**
+ * @brief Gets the directory of a path.
+ */
+static std::string parentOf(const std::string &path)
+{
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+/**
+ * @brief Syncs a file or a directory to disk.
+ * @return false if it exists and could not be synced.
+ */
+static bool syncPath(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return errno == ENOENT; // never written, e.g. after an error
+    bool synced = fsync(fd) == 0;
+    if (!synced)
+        std::cerr << "Error: Couldn't sync " << path << ": " << strerror(errno) << std::endl;
+    close(fd);
+    return synced;
+}
+
+bool PersistenceQueue::sync()
+{
+    std::vector<std::string> paths;
+    {
+        std::unique_lock<std::mutex> lock = drain();
+        paths.swap(_unsynced);
+    }
+
+    std::set<std::string> files(paths.begin(), paths.end()), directories;
+    for (auto &file : files)
+    {
+        directories.insert(parentOf(file));
+        directories.insert(parentOf(parentOf(file)));
+    }
+
+    std::vector<std::string> failed;
+    for (auto &file : files)
+        if (!syncPath(file))
+            failed.push_back(file);
+    for (auto &directory : directories)
+        if (!syncPath(directory))
+            failed.push_back(directory + "/");
+    if (failed.empty())
+        return true;
+
+    // a directory is synced again along with a file inside it
+    std::lock_guard<std::mutex> lock(_lock);
+    _unsynced.insert(_unsynced.end(), failed.begin(), failed.end());
+    return false;
+}
+
+std::unique_lock<std::mutex> PersistenceQueue::drain()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    _drained.wait(lock, [this]
+                  { return _operations.empty() && !_busy; });
+    return lock;
+}
+
+void PersistenceQueue::run()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    while (true)
+    {
+        _pending.wait(lock, [this]
+                      { return !_operations.empty() || _stopping; });
+        if (_operations.empty()) // stopping, and everything was written
+            break;
+
+        _busy = true;
+        if (_batched && _ring == nullptr)
+        {
+            try
+            {
+                _ring = std::make_unique<IoUring>(PERSISTENCE_URING_ENTRIES);
+            }
+            catch (UnrecoverableError &e)
+            {
+                std::cerr << "Error: " << e.what() << ", writing the game files one by one" << std::endl;
+                _batched = false;
+            }
+        }
+        if (_batched)
+        {
+            std::deque<FileOperation> operations;
+            operations.swap(_operations);
+            lock.unlock();
+
+            // taken first, as applyBatch() moves the operations
+            std::vector<std::string> paths;
+            for (auto &operation : operations)
+                paths.push_back(operation._path);
+            applyBatch(operations);
+
+            lock.lock();
+            _unsynced.insert(_unsynced.end(), paths.begin(), paths.end());
+            _busy = false;
+            if (_operations.empty())
+                _drained.notify_all();
+            continue;
+        }
+
+        FileOperation operation = std::move(_operations.front());
+        _operations.pop_front();
+        lock.unlock();
+
+        try
+        {
+            switch (operation._type)
+            {
+            case FileOperation::Write:
+                _files.writeToFile(operation._path, operation._content);
+                break;
+            case FileOperation::Append:
+                _files.appendToFile(operation._path, operation._content);
+                break;
+            default:
+                break;
+            }
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+
+        lock.lock();
+        _unsynced.push_back(std::move(operation._path));
+        _busy = false;
+        if (_operations.empty())
+            _drained.notify_all();
+    }
+}
+
+void PersistenceQueue::applyBatch(std::deque<FileOperation> &operations)
+{
+    // the outcome of the operations on each file, in the order of the first
+    std::vector<FileOperation> files;
+    std::unordered_map<std::string, size_t> fileOf;
+    for (auto &operation : operations)
+    {
+        auto [entry, added] = fileOf.emplace(operation._path, files.size());
+        if (added)
+            files.push_back(std::move(operation));
+        else if (operation._type == FileOperation::Write)
+            files[entry->second] = std::move(operation);
+        else
+            files[entry->second]._content += operation._content;
+    }
+
+    // the whole files first, as a game file is written before its index entry
+    std::vector<FileOperation *> written, appended;
+    for (auto &file : files)
+        (file._type == FileOperation::Write ? written : appended).push_back(&file);
+    writeFiles(written, false);
+    writeFiles(appended, true);
+}
+
+void PersistenceQueue::writeFiles(std::vector<FileOperation *> &files, bool append)
+{
+    for (size_t start = 0; start < files.size(); start += PERSISTENCE_URING_ENTRIES)
+    {
+        size_t count = std::min(files.size() - start, (size_t)PERSISTENCE_URING_ENTRIES);
+        std::vector<int> fds(count, -1);
+        std::vector<size_t> done(count, 0);
+        size_t inFlight = 0;
+
+        // opened here, as in writeToFile() and appendToFile(), then written
+        // through the ring all at once
+        for (size_t i = 0; i < count; i++)
+        {
+            FileOperation &file = *files[start + i];
+            try
+            {
+                if (!append)
+                    _files.createFile(file._path); // Assure that the directory exists
+            }
+            catch (std::exception &e)
+            {
+                std::cerr << "Error: " << e.what() << std::endl;
+                continue;
+            }
+            fds[i] = open(file._path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0666);
+            if (fds[i] == -1)
+            {
+                std::cerr << "Error: Couldn't write file: " << file._path << ": " << strerror(errno) << std::endl;
+                continue;
+            }
+            if (file._content.empty())
+                continue;
+
+            _ring->prepare(IORING_OP_WRITE, fds[i], file._content.data(), (uint32_t)file._content.size(),
+                           append ? (uint64_t)-1 : 0, i);
+            inFlight++;
+        }
+
+        while (inFlight > 0)
+        {
+            _ring->submit(1, -1);
+            struct io_uring_cqe cqe;
+            while (_ring->completion(cqe))
+            {
+                inFlight--;
+                size_t i = (size_t)cqe.user_data;
+                FileOperation &file = *files[start + i];
+                if (cqe.res <= 0)
+                {
+                    std::cerr << "Error: Couldn't write file: " << file._path << ": "
+                              << strerror(cqe.res < 0 ? -cqe.res : EIO) << std::endl;
+                    continue;
+                }
+
+                // a short write goes on from where it stopped
+                done[i] += (size_t)cqe.res;
+                if (done[i] < file._content.size())
+                {
+                    _ring->prepare(IORING_OP_WRITE, fds[i], file._content.data() + done[i],
+                                   (uint32_t)(file._content.size() - done[i]), append ? (uint64_t)-1 : done[i], i);
+                    inFlight++;
+                }
+            }
+        }
+
+        for (int fd : fds)
+            if (fd != -1)
+                close(fd);
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef PERSISTENCE_H
+#define PERSISTENCE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "uring.hpp"
+
+class DatabaseManager;
+
+/**
+ * @struct FileOperation
+ * @brief A pending change to the game files.
+ */
+struct FileOperation
+{
+    enum Type
+    {
+        Write, // Overwrite _path with _content, creating its directory
+        Append // Append _content to _path
+    };
+
+    Type _type;
+    std::string _path;
+    std::string _content;
+};
+
+/**
+ * @class PersistenceQueue
+ * @brief Writes the game files in the background, in the order requested.
+ *
+ * The game state lives in memory and in the journal, so requests only queue
+ * the text files of finished games and scores, and a writer thread writes
+ * them in the same format as always, for tooling and for restarts.
+ *
+ * With the io_uring engine the writer takes every queued operation at once,
+ * merges those on the same file, and submits the writes together, the whole
+ * files before the appends, so a game file is still written before its
+ * index entry.
+ */
+class PersistenceQueue
+{
+private:
+    DatabaseManager &_files;                // Performs the file operations
+    std::deque<FileOperation> _operations;  // Operations not yet applied
+    std::mutex _lock;                       // Protects the queue
+    std::condition_variable _pending;       // Signalled when operations are queued
+    std::condition_variable _drained;       // Signalled when the queue empties
+    bool _busy = false;                     // Whether an operation is being applied
+    std::vector<std::string> _unsynced;     // Files written since the last sync()
+    bool _stopping = false;                 // Whether the writer should exit
+    std::atomic<bool> _batched{false};     // Whether the operations are batched in an io_uring
+    std::unique_ptr<IoUring> _ring;         // Used by the writer, once batching
+    std::thread _writer;                    // Applies the operations
+
+    void run();
+
+    /**
+     * @brief Applies operations through the io_uring, merged by file.
+     */
+    void applyBatch(std::deque<FileOperation> &operations);
+
+    /**
+     * @brief Writes the content of each file through the io_uring, over it
+     * or at its end.
+     */
+    void writeFiles(std::vector<FileOperation *> &files, bool append);
+
+    void push(FileOperation::Type type, std::string path, std::string content);
+
+public:
+    /**
+     * @brief Starts the writer thread.
+     * @param files Performs the file operations.
+     */
+    PersistenceQueue(DatabaseManager &files);
+
+    /**
+     * @brief Applies every pending operation and stops the writer.
+     */
+    ~PersistenceQueue();
+
+    /**
+     * @brief Queues the write of a whole file.
+     * @param path Path to the file.
+     * @param content Content of the file.
+     */
+    void write(std::string path, std::string content);
+
+    /**
+     * @brief Queues an append to a file.
+     * @param path Path to the file.
+     * @param content Content to append.
+     */
+    void append(std::string path, std::string content);
+
+    /**
+     * @brief Selects how the writer applies the operations.
+     */
+    void setEngine(IoEngine engine);
+
+    /**
+     * @brief Waits until every queued operation was applied.
+     */
+    void flush();
+
+    /**
+     * @brief Waits until every queued operation was applied, then syncs the
+     * files written since the last call to disk, along with their directory
+     * and its parent, which a new player directory was added to.
+     * @return false if some file could not be synced; it is tried again on
+     * the next call.
+     */
+    bool sync();
+
+    /**
+     * @brief Waits until every queued operation was applied and keeps the
+     * queue locked, so no other operation starts until the lock is released.
+     * @return The held queue lock.
+     */
+    std::unique_lock<std::mutex> drain();
+};
+
+#endif
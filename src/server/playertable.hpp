@@ -0,0 +1,78 @@
+#ifndef PLAYERTABLE_H
+#define PLAYERTABLE_H
+
+#include <array>
+#include <memory>
+
+#include "../common/constants.hpp"
+#include "../common/utils.hpp"
+
+/**
+ * @class PlayerTable
+ * @brief Table of one T per possible PLID, indexed by the numeric PLID.
+ *
+ * PLIDs have PLID_MAX_SIZE digits, so every player has a fixed slot and a
+ * lookup is two array accesses, without hashing or syscalls. The slots are
+ * allocated in blocks of PLAYER_TABLE_BLOCK consecutive PLIDs, the first
+ * time one of them is written to, and never freed, so pointers to a slot
+ * stay valid. The table is not synchronized.
+ */
+template <typename T>
+class PlayerTable
+{
+private:
+    using Block = std::array<T, PLAYER_TABLE_BLOCK>;
+
+    std::array<std::unique_ptr<Block>, PLID_COUNT / PLAYER_TABLE_BLOCK> _blocks;
+
+public:
+    /**
+     * @brief Gets the slot of a player, if it was ever written to.
+     * @param plid Player ID.
+     * @return The slot, or nullptr if its block was never allocated or plid is out of range.
+     */
+    T *find(int plid)
+    {
+        if (plid < 0 || plid >= PLID_COUNT)
+            return nullptr;
+
+        Block *block = _blocks[(size_t)plid / PLAYER_TABLE_BLOCK].get();
+        if (block == nullptr)
+            return nullptr;
+        return &(*block)[(size_t)plid % PLAYER_TABLE_BLOCK];
+    }
+
+    /**
+     * @brief Gets the slot of a player, allocating its block if needed.
+     * @param plid Player ID.
+     * @return The slot.
+     * @throws UnrecoverableError if plid is out of range.
+     */
+    T &at(int plid)
+    {
+        if (plid < 0 || plid >= PLID_COUNT)
+            throw UnrecoverableError("PLID out of range: " + std::to_string(plid));
+
+        std::unique_ptr<Block> &block = _blocks[(size_t)plid / PLAYER_TABLE_BLOCK];
+        if (block == nullptr)
+            block = std::make_unique<Block>();
+        return (*block)[(size_t)plid % PLAYER_TABLE_BLOCK];
+    }
+
+    /**
+     * @brief Calls visit(plid, slot) for every slot of the allocated blocks, in PLID order.
+     */
+    template <typename Visitor>
+    void forEach(Visitor visit)
+    {
+        for (size_t i = 0; i < _blocks.size(); i++)
+        {
+            if (_blocks[i] == nullptr)
+                continue;
+            for (size_t j = 0; j < PLAYER_TABLE_BLOCK; j++)
+                visit((int)(i * PLAYER_TABLE_BLOCK + j), (*_blocks[i])[j]);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,327 @@
+#include "reactor.hpp"
+#include "commands.hpp"
+
+extern std::atomic<bool> is_exiting;
+
+TcpReactor::TcpReactor(TcpServer &tcpServer, CommandManager &manager, Server &receiver)
+    : _tcpServer(tcpServer), _manager(manager), _receiver(receiver), _deadlines(time(NULL))
+{
+    _epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epfd == -1)
+        throw SocketException();
+
+    // the listening socket must never block the loop
+    int flags = fcntl(_tcpServer._fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(_tcpServer._fd, F_SETFL, flags | O_NONBLOCK) == -1)
+        throw SocketException();
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = _tcpServer._fd;
+    if (epoll_ctl(_epfd, EPOLL_CTL_ADD, _tcpServer._fd, &event) == -1)
+        throw SocketException();
+}
+
+TcpReactor::~TcpReactor()
+{
+    for (auto &entry : _connections)
+        close(entry.first);
+    close(_epfd);
+}
+
+void TcpReactor::run()
+{
+    while (!is_exiting)
+        pollEvents();
+}
+
+void TcpReactor::drain(time_t deadline)
+{
+    _draining = true;
+    epoll_ctl(_epfd, EPOLL_CTL_DEL, _tcpServer._fd, NULL);
+
+    // kept-alive connections waiting for a request would wait forever
+    std::vector<int> idle;
+    for (auto &[fd, conn] : _connections)
+        if (conn._keepAlive && !conn._responded && conn._in.empty())
+            idle.push_back(fd);
+    for (int fd : idle)
+        closeConnection(fd);
+
+    while (!_connections.empty() && time(NULL) < deadline)
+        pollEvents();
+}
+
+void TcpReactor::pollEvents()
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    int n = epoll_wait(_epfd, events, REACTOR_MAX_EVENTS, SERVER_POLL_TIMEOUT_MS);
+    if (n == -1)
+    {
+        if (errno == EINTR) // interrupted by a signal, check is_exiting
+            return;
+        throw SocketException();
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        int fd = events[i].data.fd;
+        if (fd == _tcpServer._fd)
+        {
+            acceptConnections();
+            continue;
+        }
+
+        auto conn = _connections.find(fd);
+        if (conn != _connections.end())
+            handleEvent(conn->second, events[i].events);
+    }
+
+    // epoll_wait returns at least every SERVER_POLL_TIMEOUT_MS
+    expireConnections();
+}
+
+void TcpReactor::setDeadline(TcpConnection &conn, time_t deadline)
+{
+    conn._deadline = deadline;
+    if (conn._timer == 0 || deadline < conn._timer)
+    {
+        conn._timer = deadline;
+        _deadlines.schedule(conn._fd, deadline);
+    }
+}
+
+void TcpReactor::expireConnections()
+{
+    time_t now = time(NULL);
+    std::vector<int> expired;
+    _deadlines.advance(now, [&expired](int fd)
+                       { expired.push_back(fd); });
+
+    for (int fd : expired)
+    {
+        // the timer may have been replaced by an earlier one, or be for an
+        // earlier connection with the same fd
+        auto conn = _connections.find(fd);
+        if (conn == _connections.end() || conn->second._timer > now)
+            continue;
+
+        if (conn->second._deadline <= now)
+            closeConnection(fd);
+        else
+        {
+            // the deadline was pushed back since: one timer for the new one
+            conn->second._timer = conn->second._deadline;
+            _deadlines.schedule(fd, conn->second._deadline);
+        }
+    }
+}
+
+void TcpReactor::acceptConnections()
+{
+    // edge-triggered: keep accepting until the backlog is empty
+    while (true)
+    {
+        struct sockaddr_in addr;
+        socklen_t addrlen = sizeof(addr);
+        int fd = accept4(_tcpServer._fd, (struct sockaddr *)&addr, &addrlen,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                std::cerr << "Error: accept: " << strerror(errno) << std::endl;
+            return;
+        }
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = fd;
+        if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &event) == -1)
+        {
+            close(fd);
+            continue;
+        }
+
+        TcpConnection &conn = _connections[fd];
+        conn._fd = fd;
+        conn._addr = addr;
+        setDeadline(conn, time(NULL) + TCP_REQUEST_DEADLINE);
+    }
+}
+
+void TcpReactor::handleEvent(TcpConnection &conn, uint32_t events)
+{
+    if (events & EPOLLERR)
+    {
+        closeConnection(conn._fd);
+        return;
+    }
+
+    while (true)
+    {
+        // the response is sent before the next request is handled, so the
+        // responses go out in the order of the requests
+        if (conn._responded)
+        {
+            if (!writeConnection(conn))
+            {
+                closeConnection(conn._fd);
+                return;
+            }
+            if (responsePending(conn))
+                return; // wait for the next EPOLLOUT edge
+
+            // one request per connection, or no more once draining
+            if (!conn._keepAlive || (_draining && conn._in.find('\n') == std::string::npos))
+            {
+                closeConnection(conn._fd);
+                return;
+            }
+            conn._responded = false;
+            closeFileBody(conn._body);
+            setDeadline(conn, time(NULL) + TCP_KEEPALIVE_TIMEOUT);
+        }
+
+        size_t delimiter = conn._in.find('\n');
+        size_t length = delimiter == std::string::npos ? conn._in.size() : delimiter + 1;
+        if (length > TCP_MAX_REQUEST) // too long to be a request
+        {
+            closeConnection(conn._fd);
+            return;
+        }
+        if (delimiter != std::string::npos)
+        {
+            dispatch(conn, length);
+            continue;
+        }
+
+        if (conn._eof) // answer whatever arrived before the client closed its side
+        {
+            if (conn._in.empty())
+            {
+                closeConnection(conn._fd);
+                return;
+            }
+            dispatch(conn, length);
+            continue;
+        }
+
+        size_t buffered = conn._in.size();
+        if (!readConnection(conn))
+        {
+            closeConnection(conn._fd);
+            return;
+        }
+        if (conn._in.size() == buffered && !conn._eof)
+            return; // wait for the next EPOLLIN edge
+    }
+}
+
+bool TcpReactor::readConnection(TcpConnection &conn)
+{
+    char buffer[BUFFER_SIZE];
+
+    // edge-triggered: read until EAGAIN, unless the buffer is full, in which
+    // case it holds a request and this is called again once it is handled
+    while (conn._in.size() < TCP_MAX_PIPELINE)
+    {
+        ssize_t n = read(conn._fd, buffer, BUFFER_SIZE);
+        if (n > 0)
+        {
+            conn._in.append(buffer, (size_t)n);
+            continue;
+        }
+        if (n == 0)
+        {
+            conn._eof = true;
+            return true;
+        }
+        if (errno == EINTR)
+            continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    return true;
+}
+
+bool TcpReactor::writeConnection(TcpConnection &conn)
+{
+    while (conn._outOffset < conn._out.size())
+    {
+        // a header followed by a body goes out in the same segments as it
+        int flags = conn._body._size > 0 ? MSG_MORE : 0;
+        ssize_t n = send(conn._fd, conn._out.data() + conn._outOffset,
+                         conn._out.size() - conn._outOffset, flags);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn._outOffset += (size_t)n;
+    }
+
+    return sendFileBody(conn._fd, conn._body);
+}
+
+bool TcpReactor::responsePending(const TcpConnection &conn)
+{
+    return conn._outOffset < conn._out.size() || conn._body._size > 0;
+}
+
+void TcpReactor::dispatch(TcpConnection &conn, size_t length)
+{
+    std::string_view request = std::string_view(conn._in).substr(0, length);
+    bool framed = conn._keepAlive; // the response to KAL itself is not
+
+    if (request.size() >= 3 && packOpcode(request.data()) == packOpcode("KAL"))
+    {
+        KeepAliveCommunication kaComm;
+        try
+        {
+            kaComm.decodeRequest(request);
+            kaComm._status = "OK";
+            kaComm.encodeResponse(conn._out);
+            conn._keepAlive = true;
+        }
+        catch (ProtocolException &e)
+        {
+            conn._out = PROTOCOL_ERROR "\n";
+        }
+    }
+    else
+    {
+        _manager.handleTcpCommand(request, conn._out, _receiver, &conn._body);
+        _receiver._DB.waitDurable();
+    }
+
+    if (framed) // preceded by its size, as the connection is not closed after it
+        conn._out.insert(0, std::to_string(conn._out.size() + conn._body._size) + "\n");
+
+    conn._in.erase(0, length);
+    conn._outOffset = 0;
+    conn._responded = true;
+    setDeadline(conn, time(NULL) + TCP_WRITE_TIMEOUT);
+
+    if (_receiver.isverbose())
+    {
+        std::cout << "Client IP: " << inet_ntoa(conn._addr.sin_addr) << std::endl;
+        std::cout << "Client port: " << ntohs(conn._addr.sin_port) << std::endl
+                  << std::endl;
+    }
+}
+
+void TcpReactor::closeConnection(int fd)
+{
+    auto conn = _connections.find(fd);
+    if (conn != _connections.end())
+        closeFileBody(conn->second._body);
+
+    // closing the fd also removes it from the epoll interest list
+    close(fd);
+    _connections.erase(fd);
+}
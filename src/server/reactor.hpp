@@ -0,0 +1,131 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <string>
+#include <unordered_map>
+#include <sys/epoll.h>
+
+#include "socket.hpp"
+#include "server.hpp"
+#include "timerwheel.hpp"
+
+class CommandManager;
+
+/**
+ * @struct TcpConnection
+ * @brief State kept by the reactor for one accepted TCP connection.
+ *
+ * Bytes are accumulated in _in until a full request (terminated by '\n')
+ * has arrived, and the response is drained from _out, then from _body, as
+ * the socket allows. A kept-alive connection then goes on with the next
+ * request, which may already be in _in.
+ */
+struct TcpConnection
+{
+    int _fd;                  // The file descriptor of the connection
+    struct sockaddr_in _addr; // The address of the peer
+    std::string _in;          // Bytes received and not yet handled
+    std::string _out;         // Response bytes waiting to be written
+    size_t _outOffset = 0;    // How much of _out was already written
+    FileBody _body;           // Rest of the response, sent from a file
+    time_t _deadline;         // When the connection is closed, if still open
+    time_t _timer = 0;        // Deadline of its timer in the wheel, 0 if none
+    bool _responded = false;  // Whether a response is being sent
+    bool _keepAlive = false;  // Whether the client asked for more requests ("KAL")
+    bool _eof = false;        // Whether the client closed its side
+};
+
+/**
+ * @class TcpReactor
+ * @brief Serves the TCP requests (STR/SSB) from a single process.
+ *
+ * The reactor owns the listening socket of a TcpServer and multiplexes every
+ * accepted connection through an edge-triggered epoll instance, replacing
+ * the fork-per-connection model of TCPServer().
+ *
+ * A request must arrive within TCP_REQUEST_DEADLINE seconds of the
+ * connection and fit in TCP_MAX_REQUEST bytes, and the response must be
+ * taken within TCP_WRITE_TIMEOUT seconds, so a slow or idle client only
+ * costs its connection's state until its deadline passes. A kept-alive
+ * connection waits up to TCP_KEEPALIVE_TIMEOUT seconds for each further
+ * request.
+ */
+class TcpReactor
+{
+private:
+    TcpServer &_tcpServer;      // The server whose listening socket is used
+    CommandManager &_manager;   // Handles the complete requests
+    Server &_receiver;          // The server configuration and database
+    int _epfd;                  // The epoll instance
+    std::unordered_map<int, TcpConnection> _connections;
+    TimerWheel _deadlines;      // Deadline of every connection, by fd
+    bool _draining = false;     // Whether the connections are closed once idle
+
+    /**
+     * @brief Sets when a connection is closed, if still open.
+     *
+     * A connection keeps a single timer, scheduled again only for an earlier
+     * deadline: one that fires before the connection's deadline is re-armed.
+     */
+    void setDeadline(TcpConnection &conn, time_t deadline);
+
+    /**
+     * @brief Closes the connections past their deadline.
+     */
+    void expireConnections();
+
+    void acceptConnections();
+    void handleEvent(TcpConnection &conn, uint32_t events);
+
+    /**
+     * @brief Reads what is available on the connection, up to TCP_MAX_PIPELINE
+     * buffered bytes.
+     * @return false if the connection should be closed.
+     */
+    bool readConnection(TcpConnection &conn);
+
+    /**
+     * @brief Writes as much of the pending response as the socket accepts.
+     * @return false if the connection should be closed.
+     */
+    bool writeConnection(TcpConnection &conn);
+
+    /**
+     * @brief Checks if part of the response is still to be written.
+     */
+    bool responsePending(const TcpConnection &conn);
+
+    /**
+     * @brief Dispatches the first length bytes of _in, a request, to the
+     * command manager, or switches the connection to keep-alive.
+     */
+    void dispatch(TcpConnection &conn, size_t length);
+
+    void closeConnection(int fd);
+
+    /**
+     * @brief Waits for events and handles them, then closes the connections
+     * past their deadline.
+     */
+    void pollEvents();
+
+public:
+    TcpReactor(TcpServer &tcpServer, CommandManager &manager, Server &receiver);
+    ~TcpReactor();
+
+    /**
+     * @brief Runs the event loop until the server starts exiting.
+     */
+    void run();
+
+    /**
+     * @brief Stops accepting connections and serves the open ones until
+     * they are done, or until the deadline.
+     *
+     * A kept-alive connection is closed as soon as it has no request left
+     * to answer, and its client reconnects to whoever listens now.
+     */
+    void drain(time_t deadline);
+};
+
+#endif
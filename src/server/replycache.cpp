@@ -0,0 +1,103 @@
+#include "replycache.hpp"
+
+#include <cstring>
+#include <functional>
+
+ReplyCache::ReplyCache()
+    : _shards(new Shard[REPLY_CACHE_SHARDS]), _shardCapacity(REPLY_CACHE_SIZE / REPLY_CACHE_SHARDS)
+{
+}
+
+void ReplyCache::setCapacity(size_t capacity)
+{
+    // round up, so any positive capacity keeps at least one entry per shard
+    _shardCapacity = (capacity + REPLY_CACHE_SHARDS - 1) / REPLY_CACHE_SHARDS;
+}
+
+bool ReplyCache::enabled()
+{
+    return _shardCapacity > 0;
+}
+
+std::string ReplyCache::makeKey(const struct sockaddr_in &client, std::string_view request)
+{
+    std::string key(sizeof(client.sin_addr) + sizeof(client.sin_port) + request.size(), '\0');
+    memcpy(&key[0], &client.sin_addr, sizeof(client.sin_addr));
+    memcpy(&key[sizeof(client.sin_addr)], &client.sin_port, sizeof(client.sin_port));
+    memcpy(&key[sizeof(client.sin_addr) + sizeof(client.sin_port)], request.data(), request.size());
+    return key;
+}
+
+ReplyCache::Shard &ReplyCache::shardOf(const std::string &key)
+{
+    return _shards[std::hash<std::string>()(key) % REPLY_CACHE_SHARDS];
+}
+
+void ReplyCache::evict(Shard &shard, time_t now)
+{
+    while (!shard._order.empty() &&
+           (shard._order.front().first <= now || shard._entries.size() > _shardCapacity))
+    {
+        auto &[expiry, key] = shard._order.front();
+
+        // a reinserted key has a later entry in _order: only that one evicts it
+        auto entry = shard._entries.find(key);
+        if (entry != shard._entries.end() && entry->second._expiry == expiry)
+        {
+            shard._entries.erase(entry);
+            _evictions++;
+        }
+        shard._order.pop_front();
+    }
+}
+
+bool ReplyCache::lookup(const struct sockaddr_in &client, std::string_view request, uint32_t generation,
+                        std::string &reply)
+{
+    std::string key = makeKey(client, request);
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> guard(shard._lock);
+
+    // a reply from another generation is left to expire
+    auto entry = shard._entries.find(key);
+    if (entry == shard._entries.end() || entry->second._expiry <= time(NULL) ||
+        entry->second._generation != generation)
+    {
+        _misses++;
+        return false;
+    }
+
+    reply = entry->second._reply;
+    _hits++;
+    return true;
+}
+
+void ReplyCache::insert(const struct sockaddr_in &client, std::string_view request, uint32_t generation,
+                        const std::string &reply)
+{
+    if (reply.empty())
+        return; // nothing was sent
+
+    std::string key = makeKey(client, request);
+    Shard &shard = shardOf(key);
+    time_t now = time(NULL);
+    std::lock_guard<std::mutex> guard(shard._lock);
+
+    shard._entries[key] = Entry{reply, now + REPLY_CACHE_TTL, generation};
+    shard._order.emplace_back(now + REPLY_CACHE_TTL, std::move(key));
+    evict(shard, now);
+}
+
+ReplyCacheStats ReplyCache::stats()
+{
+    ReplyCacheStats stats;
+    stats._hits = _hits;
+    stats._misses = _misses;
+    stats._evictions = _evictions;
+    for (size_t i = 0; i < REPLY_CACHE_SHARDS; i++)
+    {
+        std::lock_guard<std::mutex> guard(_shards[i]._lock);
+        stats._entries += _shards[i]._entries.size();
+    }
+    return stats;
+}
@@ -0,0 +1,114 @@
+#ifndef REPLYCACHE_H
+#define REPLYCACHE_H
+
+#include <atomic>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <netinet/in.h>
+
+#include "../common/constants.hpp"
+
+/**
+ * @brief Counters of a ReplyCache, since the server started.
+ */
+struct ReplyCacheStats
+{
+    uint64_t _hits = 0;      // Retransmissions answered from the cache
+    uint64_t _misses = 0;    // Requests that had to be handled
+    uint64_t _evictions = 0; // Replies dropped, expired or for room
+    size_t _entries = 0;     // Replies currently kept
+};
+
+/**
+ * @class ReplyCache
+ * @brief Remembers the reply sent to each UDP request for a while.
+ *
+ * The player resends a request whose reply was lost. Handling it again would
+ * not be idempotent (a resent TRY is a DUP, a resent SNG finds the game it
+ * created), so a request equal to one recently answered, from the same
+ * address, gets the original reply byte for byte instead. Only while its
+ * player's game is in the same generation, though: once a game started or
+ * ended since, an equal request is a new one, e.g. the SNG of the next game.
+ *
+ * Replies are kept for REPLY_CACHE_TTL seconds, the time the player keeps
+ * resending, and at most the configured number of them are kept. The cache
+ * is split in REPLY_CACHE_SHARDS independently locked shards, so the UDP
+ * workers rarely wait on each other.
+ */
+class ReplyCache
+{
+private:
+    struct Entry
+    {
+        std::string _reply;
+        time_t _expiry;
+        uint32_t _generation; // Of the player's game the reply holds in
+    };
+
+    struct Shard
+    {
+        std::mutex _lock;
+        std::unordered_map<std::string, Entry> _entries;
+        std::deque<std::pair<time_t, std::string>> _order; // Keys by expiry, oldest first
+    };
+
+    std::unique_ptr<Shard[]> _shards;
+    size_t _shardCapacity; // Most entries per shard, 0 to disable the cache
+
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+    std::atomic<uint64_t> _evictions{0};
+
+    /**
+     * @brief The key of a request: the client's address and port followed by
+     * the request's bytes.
+     */
+    static std::string makeKey(const struct sockaddr_in &client, std::string_view request);
+
+    Shard &shardOf(const std::string &key);
+
+    /**
+     * @brief Drops the entries of a shard that expired, and the oldest ones
+     * while it is over capacity. The shard must be locked.
+     */
+    void evict(Shard &shard, time_t now);
+
+public:
+    ReplyCache();
+
+    /**
+     * @brief Sets the most replies kept, 0 to disable the cache.
+     * Must be called before the cache is used.
+     */
+    void setCapacity(size_t capacity);
+
+    bool enabled();
+
+    /**
+     * @brief Looks up the reply to a retransmitted request.
+     * @param generation The current generation of the player's game, see
+     * GamedataManager::gameGeneration().
+     * @param reply Where the cached reply is copied to.
+     * @return true on a hit.
+     */
+    bool lookup(const struct sockaddr_in &client, std::string_view request, uint32_t generation,
+                std::string &reply);
+
+    /**
+     * @brief Remembers the reply sent to a request.
+     * @param generation The generation of the player's game once the
+     * request was handled.
+     */
+    void insert(const struct sockaddr_in &client, std::string_view request, uint32_t generation,
+                const std::string &reply);
+
+    ReplyCacheStats stats();
+};
+
+#endif
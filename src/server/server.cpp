@@ -1,6 +1,7 @@
 #include <unistd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -8,46 +9,132 @@
 #include <string.h>
 #include <stdexcept>
 #include <fcntl.h>
+#include <memory>
+#include <thread>
+#include <poll.h>
+#include <algorithm>
 
 #include "server.hpp"
 #include "commands.hpp"
+#include "reactor.hpp"
+#include "upgrade.hpp"
+
+void UDPWorkers(std::vector<std::unique_ptr<UdpServer>> &udpServers, CommandManager &manager,
+                Server &server);
 
 void UDPServer(UdpServer &udpServer, CommandManager &manager, Server &server);
 
+void UDPBatchServer(UdpServer &udpServer, CommandManager &manager, Server &server);
+
+void UDPUringServer(UdpServer &udpServer, CommandManager &manager, Server &server);
+
 void TCPServer(TcpServer &tcpServer, CommandManager &manager, Server &server);
 
-extern bool is_exiting;
+void StatsReporter(Server &server);
+
+void GameExpiry(Server &server);
+
+extern std::atomic<bool> is_exiting;
 
 int main(int argc, char *argv[])
 {
     try
     {
         setup_signal_handlers();
+        setup_upgrade_signal_handler();
+
+        // started by an upgrade: wait for the previous process to stop
+        // changing the games before they are loaded from the journal
+        Handoff handoff;
+        bool inherited = receiveHandoff(handoff);
+
         Server server(argc, argv);
+        if (inherited)
+            acknowledgeHandoff(handoff);
 
         CommandManager commandManager; // create a new command manager
-        commandManager.registerAllCommands();
+
+        std::thread expiryThread(GameExpiry, std::ref(server));
+        std::thread statsThread;
+        if (server.getStatsInterval() > 0)
+            statsThread = std::thread(StatsReporter, std::ref(server));
+        bool upgraded = false;
 
         while (!is_exiting)
         {
             try
             {
-                UdpServer udpServer(server.getPort());
-                TcpServer tcpServer(server.getPort());
-
-                int pid = fork();
+                // one UDP socket per worker, sharing GSport with SO_REUSEPORT
+                std::vector<std::unique_ptr<UdpServer>> udpServers;
+                std::unique_ptr<TcpServer> tcpServer;
+                if (handoff._tcpFd != -1)
+                {
+                    for (int fd : handoff._udpFds)
+                        udpServers.push_back(std::make_unique<UdpServer>(server.getPort(), fd));
+                    tcpServer = std::make_unique<TcpServer>(server.getPort(), handoff._tcpFd);
+                    handoff = Handoff(); // a later iteration opens its own
+                }
+                else
+                {
+                    for (int i = 0; i < server.getUdpWorkers(); i++)
+                        udpServers.push_back(std::make_unique<UdpServer>(server.getPort(),
+                                                                         server.getUdpWorkers() > 1));
+                    tcpServer = std::make_unique<TcpServer>(server.getPort());
+                }
 
-                if (pid < 0) // fork failed
-                    exit(1);
-                else if (pid == 0) // child process
+                // gameplay is served by the UDP worker threads and STR/SSB by
+                // this thread (or its pool), all of them sharing the same
+                // GamedataManager
+                std::thread udpThread(UDPWorkers, std::ref(udpServers),
+                                      std::ref(commandManager), std::ref(server));
+                std::unique_ptr<TcpReactor> reactor;
+                try
                 {
-                    tcpServer.closeServer();
-                    UDPServer(udpServer, commandManager, server); // start udp server
+                    if (server.getTcpModel() == TcpModel::Fork)
+                        TCPServer(*tcpServer, commandManager, server);
+                    else if (server.getTcpModel() == TcpModel::Pool)
+                        server._tcpPool.run(*tcpServer, commandManager, server);
+                    else
+                    {
+                        reactor = std::make_unique<TcpReactor>(*tcpServer, commandManager, server);
+                        reactor->run();
+                    }
                 }
-                else // parent process
+                catch (...)
                 {
-                    udpServer.closeServer();
-                    TCPServer(tcpServer, commandManager, server);
+                    is_exiting = true; // stop the UDP workers before unwinding
+                    udpThread.join();
+                    throw;
+                }
+                udpThread.join();
+
+                if (upgrade_requested)
+                {
+                    // nothing changes the games from here on
+                    expiryThread.join();
+                    server._DB.prepareHandOver();
+
+                    std::vector<int> udpFds;
+                    for (auto &udpServer : udpServers)
+                        udpFds.push_back(udpServer->getFd());
+                    if (handOver(argv, tcpServer->_fd, udpFds))
+                    {
+                        upgraded = true;
+                        if (reactor != nullptr)
+                            reactor->drain(time(NULL) + UPGRADE_DRAIN_TIMEOUT);
+                        break;
+                    }
+
+                    // the new process did not start: carry on serving
+                    server._DB.resumeAfterHandOver();
+                    upgrade_requested = false;
+                    is_exiting = false;
+                    expiryThread = std::thread(GameExpiry, std::ref(server));
+                    if (statsThread.joinable())
+                    {
+                        statsThread.join();
+                        statsThread = std::thread(StatsReporter, std::ref(server));
+                    }
                 }
             }
             catch (ProtocolException &e)
@@ -75,9 +162,17 @@ int main(int argc, char *argv[])
                 break;             // Exit loop
             }
         }
-        // if exiting, finish all games
-        if (is_exiting)
+        if (expiryThread.joinable())
+            expiryThread.join();
+        if (statsThread.joinable())
+            statsThread.join();
+
+        // if exiting, finish all games, unless the new process took them over
+        if (is_exiting && !upgraded)
+        {
             server._DB.quitAllGames();
+            server._DB.prepareHandOver(); // the next start needs no rebuild
+        }
     }
     catch (std::exception &e)
     {
@@ -93,39 +188,115 @@ int main(int argc, char *argv[])
     return EXIT_SUCCESS;
 }
 
+#define SERVER_USAGE "Wrong args\nCorrect usage: [-p GSport] [-v] [-w N] " \
+                     "[--tcp-model=epoll|fork|pool] "                  \
+                     "[--tcp-threads=N] [--io-engine=blocking|uring] " \
+                     "[--udp-batch=N] "                                \
+                     "[--udp-batch-wait=US] "                          \
+                     "[--durability=none|periodic|group] "             \
+                     "[--commit-window=US] [--sync-interval=MS] "      \
+                     "[--stats-interval=S] [--reply-cache=N] "         \
+                     "[--ip-rate=N] [--plid-rate=N] [--shed-queue=PCT]\n"
+
+/**
+ * @brief Reads the value of a "--name=value" option.
+ * @return true if arg is the given option, false otherwise.
+ */
+static bool readOption(const char *arg, const char *name, std::string &value)
+{
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=')
+        return false;
+
+    value = arg + length + 1;
+    return true;
+}
+
+/**
+ * @brief Parses the numeric value of an option, checking its bounds.
+ */
+static int parseOptionValue(std::string value, int min, int max)
+{
+    if (value.empty() || value.length() > 9 || is_not_numeric(value))
+        throw UnrecoverableError(SERVER_USAGE);
+
+    int parsed = std::stoi(value);
+    if (parsed < min || parsed > max)
+        throw UnrecoverableError(SERVER_USAGE);
+    return parsed;
+}
+
 Server::Server(int argc, char **argv)
 {
-    switch (argc)
-    {
-    case 1: // no arguments
-        return;
-    case 2: // with -v
-        if (strcmp(argv[1], "-v") == 0)
-            _verbose = true;
-        else
-            std::cout << "Wrong args\nCorrect usage: [-p GSport] [-v]\n";
-        return;
-    case 3: // with -p [GSport]
-        if (strcmp(argv[1], "-p") == 0)
-            _gsport = argv[2];
-        else
-            std::cout << "Wrong args\nCorrect usage: [-p GSport] [-v]\n";
-        break;
-    case 4: // with -p [GSport] -v
-        if (strcmp(argv[1], "-p") == 0)
-            _gsport = argv[2];
+    std::string value;
+    int ipRate = ADMISSION_IP_RATE, plidRate = ADMISSION_PLID_RATE, queueLimit = ADMISSION_QUEUE_LIMIT;
 
-        if (strcmp(argv[3], "-v") == 0)
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-v") == 0)
             _verbose = true;
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            _gsport = argv[++i];
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            _udpWorkers = parseOptionValue(argv[++i], 1, UDP_MAX_WORKERS);
+        else if (strcmp(argv[i], "--tcp-model=epoll") == 0)
+            _tcpModel = TcpModel::Epoll;
+        else if (strcmp(argv[i], "--tcp-model=fork") == 0)
+            _tcpModel = TcpModel::Fork;
+        else if (strcmp(argv[i], "--tcp-model=pool") == 0)
+            _tcpModel = TcpModel::Pool;
+        else if (readOption(argv[i], "--tcp-threads", value))
+            _tcpPool.setThreads(parseOptionValue(value, 1, TCP_POOL_MAX_THREADS));
+        else if (readOption(argv[i], "--udp-batch", value))
+            _udpBatch = parseOptionValue(value, 1, UDP_BATCH_MAX);
+        else if (strcmp(argv[i], "--io-engine=blocking") == 0)
+            _ioEngine = IoEngine::Blocking;
+        else if (strcmp(argv[i], "--io-engine=uring") == 0)
+            _ioEngine = IoEngine::Uring;
+        else if (readOption(argv[i], "--udp-batch-wait", value))
+            _udpBatchWait = parseOptionValue(value, 0, 1000000);
+        else if (strcmp(argv[i], "--durability=none") == 0)
+            _durability = Durability::None;
+        else if (strcmp(argv[i], "--durability=periodic") == 0)
+            _durability = Durability::Periodic;
+        else if (strcmp(argv[i], "--durability=group") == 0)
+            _durability = Durability::GroupCommit;
+        else if (readOption(argv[i], "--commit-window", value))
+            _commitWindow = parseOptionValue(value, 0, 1000000);
+        else if (readOption(argv[i], "--sync-interval", value))
+            _syncInterval = parseOptionValue(value, 1, 3600000);
+        else if (readOption(argv[i], "--stats-interval", value))
+            _statsInterval = parseOptionValue(value, 0, 86400);
+        else if (readOption(argv[i], "--reply-cache", value))
+            _replyCache.setCapacity((size_t)parseOptionValue(value, 0, 100000000));
+        else if (readOption(argv[i], "--ip-rate", value))
+            ipRate = parseOptionValue(value, 0, 100000000);
+        else if (readOption(argv[i], "--plid-rate", value))
+            plidRate = parseOptionValue(value, 0, 100000000);
+        else if (readOption(argv[i], "--shed-queue", value))
+            queueLimit = parseOptionValue(value, 0, 100);
         else
-            std::cout << "Wrong args\nCorrect usage: [-p GSport] [-v]\n";
-        break;
-    default:
-        std::cout << "Wrong args\nCorrect usage: [-p GSport] [-v]\n";
-        return;
+        {
+            std::cout << SERVER_USAGE;
+            break;
+        }
     }
 
     validate_port(_gsport);
+
+    if (_ioEngine == IoEngine::Uring && !IoUring::supported())
+    {
+        std::cout << "io_uring is not available, using blocking I/O" << std::endl;
+        _ioEngine = IoEngine::Blocking;
+    }
+    _DB.setIoEngine(_ioEngine);
+
+    _admission.setLimits(ipRate, plidRate, queueLimit);
+
+    if (_durability == Durability::Periodic)
+        _DB.setDurability(_durability, std::chrono::milliseconds(_syncInterval));
+    else
+        _DB.setDurability(_durability, std::chrono::microseconds(_commitWindow));
 }
 
 bool Server::isverbose()
@@ -138,14 +309,201 @@ std::string Server::getPort()
     return _gsport;
 }
 
+TcpModel Server::getTcpModel()
+{
+    return _tcpModel;
+}
+
+IoEngine Server::getIoEngine()
+{
+    return _ioEngine;
+}
+
+int Server::getUdpBatch()
+{
+    return _udpBatch;
+}
+
+int Server::getUdpBatchWait()
+{
+    return _udpBatchWait;
+}
+
+int Server::getUdpWorkers()
+{
+    return _udpWorkers;
+}
+
+int Server::getStatsInterval()
+{
+    return _statsInterval;
+}
+
+void Server::printStats(std::ostream &out)
+{
+    _DB.printStats(out);
+
+    ReplyCacheStats replies = _replyCache.stats();
+    uint64_t requests = replies._hits + replies._misses;
+    out << "reply cache: " << replies._hits << " hits, " << replies._misses << " misses";
+    if (requests > 0)
+        out << ", " << 100.0 * (double)replies._hits / (double)requests << "% hit rate";
+    out << ", " << replies._entries << " entries, " << replies._evictions << " evictions" << std::endl;
+
+    AdmissionStats admission = _admission.stats();
+    out << "admission: " << admission._admitted << " admitted, "
+        << admission._overIpRate << " over IP rate, " << admission._overPlidRate << " over PLID rate, "
+        << admission._dropped << " dropped for a full queue" << std::endl;
+
+    if (_tcpModel != TcpModel::Pool)
+        return;
+    std::vector<TcpWorkerStats> workers = _tcpPool.stats();
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        TcpWorkerStats &worker = workers[i];
+        uint64_t served = std::max<uint64_t>(worker._requests, 1);
+        out << "tcp worker " << i << ": " << worker._requests << " requests, queue wait avg "
+            << worker._waitTotalUs / served << " us max " << worker._waitMaxUs
+            << " us, service avg " << worker._serviceTotalUs / served << " us max "
+            << worker._serviceMaxUs << " us" << std::endl;
+    }
+}
+
+void StatsReporter(Server &server)
+{
+    auto interval = std::chrono::seconds(server.getStatsInterval());
+    auto next = std::chrono::steady_clock::now() + interval;
+
+    while (!is_exiting)
+    {
+        // sleep in short steps, so a shutdown is noticed
+        if (std::chrono::steady_clock::now() < next)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(SERVER_POLL_TIMEOUT_MS / 10));
+            continue;
+        }
+        server.printStats(std::cout);
+        next += interval;
+    }
+}
+
+void GameExpiry(Server &server)
+{
+    while (!is_exiting)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(GAME_EXPIRY_TICK_MS));
+        try
+        {
+            server._DB.expireGames();
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            is_exiting = true;
+        }
+    }
+}
+
+void UDPWorkers(std::vector<std::unique_ptr<UdpServer>> &udpServers, CommandManager &manager,
+                Server &server)
+{
+    // each worker has its own socket bound to GSport with SO_REUSEPORT and
+    // the kernel spreads the datagrams between them
+    auto worker = [&manager, &server](UdpServer &socket)
+    {
+        try
+        {
+            UDPServer(socket, manager, server);
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            is_exiting = true; // stop the other workers too
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < udpServers.size(); i++)
+        threads.emplace_back(worker, std::ref(*udpServers[i]));
+
+    worker(*udpServers[0]);
+
+    for (auto &thread : threads)
+        thread.join();
+}
+
+/**
+ * @brief Answers a UDP request from the reply cache, or handles it.
+ * @param generation Set to the generation of the player's game the reply
+ * holds in, to cache it with.
+ * @return true if the request was handled and its reply can be cached,
+ * once durable.
+ */
+static bool answerUdpRequest(CommandManager &manager, Server &server, const struct sockaddr_in &client,
+                             std::string_view request, std::string &reply, uint32_t &generation)
+{
+    ReplyCache &cache = server._replyCache;
+    if (!cache.enabled())
+    {
+        manager.handleCommand(request, reply, server);
+        return false;
+    }
+
+    int plid = requestPlid(request);
+    uint32_t before = server._DB.gameGeneration(plid);
+    if (cache.lookup(client, request, before, reply))
+        return false;
+
+    uint32_t bumps = GamedataManager::ownGenerationBumps();
+    manager.handleCommand(request, reply, server);
+    generation = server._DB.gameGeneration(plid);
+
+    // if another thread also started or ended a game of the player meanwhile,
+    // the generation the reply holds in is unknown: it is not cached
+    return generation - before == GamedataManager::ownGenerationBumps() - bumps;
+}
+
 void UDPServer(UdpServer &udpServer, CommandManager &manager, Server &server)
 {
     bool verbose = server.isverbose();
 
+    if (server.getIoEngine() == IoEngine::Uring)
+    {
+        UDPUringServer(udpServer, manager, server);
+        return;
+    }
+    if (server.getUdpBatch() > 1)
+    {
+        UDPBatchServer(udpServer, manager, server);
+        return;
+    }
+
+    std::string response; // reused for every reply
+    ReplyCache &cache = server._replyCache;
+    AdmissionControl &admission = server._admission;
+
     while (!is_exiting)
     {
         std::string message = udpServer.receive();
-        std::string response = manager.handleCommand(message, server);
+        if (message.empty()) // timed out, check is_exiting
+            continue;
+
+        const struct sockaddr_in &client = udpServer.getClientAddress();
+        int fill = admission.watchesQueue() ? udpServer.queueFill() : 0;
+        Admission verdict = admission.admit(client, message, fill);
+        if (verdict == Admission::Drop)
+            continue;
+
+        if (verdict == Admission::Reject)
+            response = PROTOCOL_ERROR "\n";
+        else
+        {
+            uint32_t generation;
+            bool cacheable = answerUdpRequest(manager, server, client, message, response, generation);
+            server._DB.waitDurable();
+            if (cacheable)
+                cache.insert(client, message, generation, response);
+        }
 
         if (verbose)
         {
@@ -157,78 +515,365 @@ void UDPServer(UdpServer &udpServer, CommandManager &manager, Server &server)
     }
 }
 
-void TCPServer(TcpServer &tcpServer, CommandManager &manager, Server &server)
+void UDPBatchServer(UdpServer &udpServer, CommandManager &manager, Server &server)
 {
     bool verbose = server.isverbose();
+    int wait = server.getUdpBatchWait();
 
-    int newfd, pid, ret;
+    UdpBatch batch((size_t)server.getUdpBatch());
+    ReplyCache &cache = server._replyCache;
+    AdmissionControl &admission = server._admission;
+    std::vector<bool> handled(batch.capacity());
+    std::vector<uint32_t> generations(batch.capacity());
+
+    while (!is_exiting)
+    {
+        size_t n = udpServer.receiveBatch(batch, wait);
+        int fill = n > 0 && admission.watchesQueue() ? udpServer.queueFill() : 0;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            // a dropped request keeps the empty reply, which is not sent
+            Admission verdict = admission.admit(batch._addrs[i], batch.message(i), fill);
+            handled[i] = false;
+            if (verdict == Admission::Reject)
+                batch._replies[i] = PROTOCOL_ERROR "\n";
+            if (verdict != Admission::Admit)
+                continue;
+
+            handled[i] = answerUdpRequest(manager, server, batch._addrs[i], batch.message(i),
+                                          batch._replies[i], generations[i]);
+
+            if (verbose)
+            {
+                std::cout << "Client IP: " << batch.getClientIP(i) << std::endl;
+                std::cout << "Client port: " << batch.getClientPort(i) << std::endl
+                          << std::endl;
+            }
+        }
+        // one wait covers the whole batch, as its records were appended in order
+        server._DB.waitDurable();
+
+        // cached once durable, so a retransmission never gets an earlier reply
+        for (size_t i = 0; i < n; i++)
+            if (handled[i])
+                cache.insert(batch._addrs[i], batch.message(i), generations[i], batch._replies[i]);
+
+        udpServer.sendBatch(batch);
+    }
+}
+
+// What a completion of UDPUringServer() is for, in the low bits of its user data
+#define URING_RECEIVE 0
+#define URING_SEND 1
+#define URING_CANCEL 2
+
+void UDPUringServer(UdpServer &udpServer, CommandManager &manager, Server &server)
+{
+    bool verbose = server.isverbose();
+
+    // each slot of the batch always has a receive posted, or a reply being
+    // sent with the slot's next receive linked after it, so a slot's buffers
+    // are only written by the kernel once its reply is out
+    UdpBatch batch((size_t)server.getUdpBatch());
+    size_t slots = batch.capacity();
+    IoUring ring((unsigned)(2 * slots));
+    std::vector<struct msghdr> replies(slots);
+    std::vector<struct iovec> replyIovs(slots);
+    std::vector<bool> posted(slots, false), handled(slots);
+    std::vector<uint32_t> generations(slots);
+    std::vector<size_t> received;
+    size_t pending = 0, sending = 0; // operations in flight, and sends among them
+
+    ReplyCache &cache = server._replyCache;
+    AdmissionControl &admission = server._admission;
+
+    // the ring has an entry for the receive and the send of every slot, but
+    // a submit may leave entries behind when the kernel is short of resources
+    auto reserve = [&](unsigned count)
+    {
+        while (ring.space() < count)
+            ring.submit(0, 0);
+    };
+
+    auto receive = [&](size_t i)
+    {
+        // the kernel overwrites the lengths, so reset them every time
+        batch._msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        batch._iovs[i].iov_len = BUFFER_SIZE;
+        reserve(1);
+        ring.prepare(IORING_OP_RECVMSG, udpServer.getFd(), &batch._msgs[i].msg_hdr, 1, 0, i << 2 | URING_RECEIVE);
+        posted[i] = true;
+        pending++;
+    };
+
+    auto reply = [&](size_t i, bool link)
+    {
+        replyIovs[i].iov_base = (void *)batch._replies[i].data();
+        replyIovs[i].iov_len = batch._replies[i].size();
+        memset(&replies[i], 0, sizeof(replies[i]));
+        replies[i].msg_name = &batch._addrs[i];
+        replies[i].msg_namelen = sizeof(struct sockaddr_in);
+        replies[i].msg_iov = &replyIovs[i];
+        replies[i].msg_iovlen = 1;
+        // a linked receive is submitted along with its send
+        reserve(link ? 2 : 1);
+        struct io_uring_sqe *sqe = ring.prepare(IORING_OP_SENDMSG, udpServer.getFd(), &replies[i], 1, 0,
+                                                i << 2 | URING_SEND);
+        if (link)
+            sqe->flags |= IOSQE_IO_LINK;
+        sending++;
+        pending++;
+    };
+
+    // sorts a completion out, returning the slot of a received datagram
+    auto complete = [&](const struct io_uring_cqe &cqe, size_t &slot)
+    {
+        slot = (size_t)(cqe.user_data >> 2);
+        switch (cqe.user_data & 3)
+        {
+        case URING_SEND: // a failed send is a lost reply, and cancels the linked receive
+            pending--;
+            sending--;
+            return false;
+        case URING_RECEIVE:
+            pending--;
+            posted[slot] = false;
+            if (cqe.res >= 0)
+            {
+                batch._msgs[slot].msg_len = (unsigned int)cqe.res;
+                return true;
+            }
+            if (cqe.res != -ECANCELED && cqe.res != -EINTR && cqe.res != -EAGAIN)
+            {
+                errno = -cqe.res;
+                throw SocketException();
+            }
+            if (!is_exiting)
+                receive(slot);
+            return false;
+        default:
+            return false;
+        }
+    };
+
+    // collects the slots that received a datagram
+    auto reap = [&]()
+    {
+        received.clear();
+        struct io_uring_cqe cqe;
+        size_t slot;
+        while (ring.completion(cqe))
+            if (complete(cqe, slot))
+                received.push_back(slot);
+    };
+
+    // answers the received datagrams, then receives again in their slots
+    // unless stopping
+    auto serve = [&](bool again)
+    {
+        int fill = admission.watchesQueue() ? udpServer.queueFill() : 0;
+        for (size_t j : received)
+        {
+            // a dropped request keeps the empty reply, which is not sent
+            batch._replies[j].clear();
+            Admission verdict = admission.admit(batch._addrs[j], batch.message(j), fill);
+            handled[j] = false;
+            if (verdict == Admission::Reject)
+                batch._replies[j] = PROTOCOL_ERROR "\n";
+            if (verdict != Admission::Admit)
+                continue;
+
+            handled[j] = answerUdpRequest(manager, server, batch._addrs[j], batch.message(j),
+                                          batch._replies[j], generations[j]);
+
+            if (verbose)
+            {
+                std::cout << "Client IP: " << batch.getClientIP(j) << std::endl;
+                std::cout << "Client port: " << batch.getClientPort(j) << std::endl
+                          << std::endl;
+            }
+        }
+        // one wait covers the whole batch, as its records were appended in order
+        server._DB.waitDurable();
+
+        // cached once durable, so a retransmission never gets an earlier reply
+        for (size_t j : received)
+        {
+            if (handled[j])
+                cache.insert(batch._addrs[j], batch.message(j), generations[j], batch._replies[j]);
+            if (!batch._replies[j].empty())
+                reply(j, again);
+            if (again)
+                receive(j);
+        }
+    };
+
+    for (size_t i = 0; i < slots; i++)
+        receive(i);
+
+    while (!is_exiting)
+    {
+        // wait for a datagram for a while, so a shutdown is noticed
+        ring.submit(1, SERVER_POLL_TIMEOUT_MS);
+        reap();
+        if (!received.empty())
+            serve(true);
+    }
+
+    // the kernel writes into the batch until every operation completed:
+    // once the replies are out, cancel the receives still posted, and
+    // answer what they received meanwhile, as the games are still ours
+    bool cancelled = false;
+    while (pending > 0)
+    {
+        if (!cancelled && sending == 0)
+        {
+            for (size_t i = 0; i < slots; i++)
+                if (posted[i])
+                {
+                    reserve(1);
+                    ring.prepare(IORING_OP_ASYNC_CANCEL, -1, nullptr, 0, 0, URING_CANCEL)->addr =
+                        i << 2 | URING_RECEIVE;
+                }
+            cancelled = true;
+        }
+        ring.submit(1, SERVER_POLL_TIMEOUT_MS);
+        reap();
+        if (!received.empty())
+            serve(false);
+    }
+}
+
+bool serveTcpConnection(int fd, const struct sockaddr_in &addr, CommandManager &manager, Server &server)
+{
     char buffer[128];
-    struct sockaddr_in addr;
-    char *ptr;
     ssize_t n, nw;
     std::string message;
 
+    struct timeval read_timeout;
+    read_timeout.tv_sec = TCP_READ_TIMEOUT;
+    read_timeout.tv_usec = 0;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof(read_timeout)) < 0)
+        return false;
+
+    struct timeval write_timeout;
+    write_timeout.tv_sec = TCP_WRITE_TIMEOUT;
+    write_timeout.tv_usec = 0;
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &write_timeout, sizeof(write_timeout)) < 0)
+        return false;
+
+    // read until the delimiter, the end of the stream or the deadline
+    time_t deadline = time(NULL) + TCP_REQUEST_DEADLINE;
+    while (message.find('\n') == std::string::npos)
+    {
+        struct pollfd request = {fd, POLLIN, 0};
+        time_t left = deadline - time(NULL);
+        if (left <= 0 || poll(&request, 1, (int)left * 1000) <= 0)
+            return false;
+
+        n = read(fd, buffer, sizeof(buffer));
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1) // error
+            return false;
+        if (n == 0)
+            break;
+
+        // add buffer to string
+        message.append(buffer, (size_t)n);
+        if (message.size() > TCP_MAX_REQUEST && message.find('\n') >= TCP_MAX_REQUEST)
+            return false; // too long to be a request
+    }
+    if (message.empty())
+        return false;
+    size_t delimiter = message.find('\n');
+    size_t length = delimiter == std::string::npos ? message.size() : delimiter + 1;
+
+    std::string response;
+    FileBody body;
+    manager.handleTcpCommand(std::string_view(message).substr(0, length), response, server, &body);
+
+    // with a body to follow, the header waits for it, in the same segments
+    const char *ptr = response.c_str();
+    n = static_cast<ssize_t>(response.size());
+    while (n > 0)
+    {
+        if ((nw = send(fd, ptr, (size_t)n, body._size > 0 ? MSG_MORE : 0)) <= 0) // error
+        {
+            closeFileBody(body);
+            return false;
+        }
+        n -= nw;
+        ptr += nw;
+    }
+    // on this blocking socket, a body left over is a send timeout
+    bool sent = sendFileBody(fd, body) && body._size == 0;
+    closeFileBody(body);
+    if (!sent)
+        return false;
+
+    if (server.isverbose())
+    {
+        // inet_ntoa's buffer is shared by the threads of the pool model
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        std::cout << "Client IP: " << ip << std::endl;
+        std::cout << "Client port: " << ntohs(addr.sin_port) << std::endl
+                  << std::endl;
+    }
+    return true;
+}
+
+void TCPServer(TcpServer &tcpServer, CommandManager &manager, Server &server)
+{
+    int newfd, pid, ret;
+    struct sockaddr_in addr;
+
+    // the children are never waited for
+    signal(SIGCHLD, SIG_IGN);
+
     while (!is_exiting)
     {
+        // wait for a connection for a while, so a shutdown is noticed
+        struct pollfd pfd = {tcpServer._fd, POLLIN, 0};
+        if (poll(&pfd, 1, SERVER_POLL_TIMEOUT_MS) <= 0)
+            continue;
+
         socklen_t addrlen = sizeof(addr);
         do
             newfd = accept(tcpServer._fd, (struct sockaddr *)&addr, &addrlen);
 
         while (newfd == -1 && errno == EINTR && !is_exiting);
-        if (is_exiting)
-        {
-            close(tcpServer._fd);
+        if (is_exiting) // the socket is closed by its owner, or handed over
             return;
-        }
 
         if (newfd == -1) // error
             exit(1);
 
-        struct timeval read_timeout;
-        read_timeout.tv_sec = TCP_READ_TIMEOUT;
-        read_timeout.tv_usec = 0;
-        if (setsockopt(newfd, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof(read_timeout)) < 0) 
-            throw SocketException();
-
-        struct timeval write_timeout;
-        write_timeout.tv_sec = TCP_WRITE_TIMEOUT;
-        write_timeout.tv_usec = 0;
-        if (setsockopt(newfd, SOL_SOCKET, SO_SNDTIMEO, &write_timeout, sizeof(write_timeout)) < 0) 
-            throw SocketException();
+        {
+            // the other threads hold none of the locks the child takes, and
+            // stdout is left empty, so the child never prints the parent's
+            // output again
+            auto locks = server._DB.lockForFork();
+            flockfile(stdout);
+            fflush(stdout);
+            pid = fork();
+            if (pid != 0) // the child's only thread owns it
+                funlockfile(stdout);
+        }
 
-        if ((pid = fork()) == -1) // error
+        if (pid == -1) // error
             exit(1);
         else if (pid == 0) // child
         {
-            {
-                close(tcpServer._fd);
-                n = read(newfd, buffer, 128);
-                if (n == -1) // error
-                    exit(1);
-
-                // add buffer to string
-                message.append(buffer, (size_t)n);
-
-                std::string response = manager.handleCommand(message, server);
-
-                ptr = (char *)response.c_str();
-                n = static_cast<ssize_t>(response.size());
-                while (n > 0)
-                {
-                    if ((nw = write(newfd, ptr, (size_t)n)) <= 0) // error
-                        exit(1);
-                    n -= nw;
-                    ptr += nw;
-                }
-                if (verbose)
-                {
-                    std::cout << "Client IP: " << tcpServer.getClientIP() << std::endl;
-                    std::cout << "Client port: " << tcpServer.getClientPort() << std::endl
-                              << std::endl;
-                }
-                close(newfd);
-                exit(0);
-            }
+            close(tcpServer._fd);
+            bool served = serveTcpConnection(newfd, addr, manager, server);
+            close(newfd);
+            // without the atexit handlers and static destructors of the
+            // parent's threads
+            fflush(stdout);
+            _exit(served ? 0 : 1);
         }
 
         do
@@ -237,5 +882,4 @@ void TCPServer(TcpServer &tcpServer, CommandManager &manager, Server &server)
         if (ret == -1) // error
             exit(1);
     }
-
 }
@@ -7,6 +7,22 @@
 #include "socket.hpp"
 
 #include "database.hpp"
+#include "replycache.hpp"
+#include "admission.hpp"
+#include "tcppool.hpp"
+#include "uring.hpp"
+
+/**
+ * @brief How the TCP requests (STR/SSB) are served.
+ */
+enum class TcpModel
+{
+    Fork, // one forked child per accepted connection
+    Epoll, // a single process multiplexing every connection
+    Pool   // a fixed pool of threads, fed by an accepting thread
+};
+
+class CommandManager;
 
 class Server
 /**
@@ -20,14 +36,54 @@ class Server
 private:
     std::string _gsport = DEFAULT_PORT;
     bool _verbose = false;
+    TcpModel _tcpModel = TcpModel::Epoll;
+    IoEngine _ioEngine = IoEngine::Blocking;
+    int _udpBatch = UDP_BATCH_SIZE;       // datagrams handled per recvmmsg
+    int _udpBatchWait = UDP_BATCH_WAIT_US; // how long to wait for a batch to fill
+    int _udpWorkers = 1;                   // threads serving the UDP requests
+    Durability _durability = Durability::None;
+    int _commitWindow = JOURNAL_COMMIT_WINDOW_US; // microseconds, with Durability::GroupCommit
+    int _syncInterval = JOURNAL_SYNC_INTERVAL_MS; // milliseconds, with Durability::Periodic
+    int _statsInterval = 0;                       // seconds between statistics, 0 for none
 
 public:
     GamedataManager _DB = GamedataManager();
+    ReplyCache _replyCache; // UDP replies, resent to retransmitted requests
+    AdmissionControl _admission; // Which UDP requests are handled
+    TcpPool _tcpPool;            // Serves the TCP requests with the pool model
     Server(int argc, char **argv);
 
     bool isverbose();
 
     std::string getPort();
+
+    TcpModel getTcpModel();
+
+    IoEngine getIoEngine();
+
+    int getUdpBatch();
+
+    int getUdpBatchWait();
+
+    int getUdpWorkers();
+
+    int getStatsInterval();
+
+    /**
+     * @brief Writes the server's statistics.
+     * @param out Where to write them.
+     */
+    void printStats(std::ostream &out);
 };
 
+/**
+ * @brief Reads a request from an accepted TCP connection and answers it,
+ * for the fork and pool models. The connection is left open.
+ * @param fd The connection.
+ * @param addr The address of the peer.
+ * @return false if no request arrived in time or the response could not be
+ * sent.
+ */
+bool serveTcpConnection(int fd, const struct sockaddr_in &addr, CommandManager &manager, Server &server);
+
 #endif
\ No newline at end of file
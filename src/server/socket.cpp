@@ -1,6 +1,11 @@
 #include "socket.hpp"
 
-UdpServer::UdpServer(std::string gsport)
+#include <chrono>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <linux/sock_diag.h>
+
+UdpServer::UdpServer(std::string gsport, bool reusePort)
 {
     int errcode;
 
@@ -21,6 +26,18 @@ UdpServer::UdpServer(std::string gsport)
         throw SocketException();
     }
 
+    // several sockets bound to the same port share its datagrams
+    int one = 1;
+    if (reusePort && setsockopt(_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0)
+        throw SocketException();
+
+    // wake up periodically so the receiving thread can notice a shutdown
+    struct timeval timeout;
+    timeout.tv_sec = SERVER_POLL_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (SERVER_POLL_TIMEOUT_MS % 1000) * 1000;
+    if (setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
+        throw SocketException();
+
     errcode = bind(_fd, _res->ai_addr, _res->ai_addrlen);
     if (errcode == -1)
     {
@@ -30,6 +47,24 @@ UdpServer::UdpServer(std::string gsport)
     std::cout << "UDP server initialized on port " << gsport << std::endl;
 }
 
+UdpServer::UdpServer(std::string gsport, int fd) : _fd(fd)
+{
+    memset(&_hints, 0, sizeof(_hints));
+    _hints.ai_family = AF_INET;
+    _hints.ai_socktype = SOCK_DGRAM;
+    _hints.ai_flags = AI_PASSIVE;
+
+    // the address info only serves as the buffer of the sender's address
+    if (getaddrinfo(NULL, gsport.c_str(), &_hints, &_res) != 0)
+        throw SocketException();
+    std::cout << "UDP server inherited on port " << gsport << std::endl;
+}
+
+int UdpServer::getFd()
+{
+    return _fd;
+}
+
 void UdpServer::send(std::string &message)
 {
     size_t n = message.size();
@@ -50,11 +85,110 @@ std::string UdpServer::receive()
     ssize_t bytes_received = recvfrom(_fd, buffer, BUFFER_SIZE, 0, _res->ai_addr, &_res->ai_addrlen);
     if (bytes_received == -1)
     {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+            return ""; // interrupted or timed out, nothing received
         throw SocketException();
     }
     return std::string(buffer, (size_t)bytes_received);
 }
 
+size_t UdpServer::receiveBatch(UdpBatch &batch, int waitUs)
+{
+    size_t capacity = batch.capacity();
+    for (size_t i = 0; i < capacity; i++)
+    {
+        // the kernel overwrites the lengths, so reset them every batch
+        batch._msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        batch._iovs[i].iov_len = BUFFER_SIZE;
+    }
+
+    // block until at least one datagram arrives, then take what is queued
+    int n = recvmmsg(_fd, batch._msgs.data(), (unsigned int)capacity, MSG_WAITFORONE, NULL);
+    if (n == -1)
+    {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            batch._count = 0;
+            return 0;
+        }
+        throw SocketException();
+    }
+    batch._count = (size_t)n;
+
+    if (waitUs > 0 && batch._count < capacity)
+    {
+        // keep collecting until the batch fills up or the wait expires
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(waitUs);
+        while (batch._count < capacity)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0)
+                break;
+
+            struct timespec timeout;
+            timeout.tv_sec = (time_t)(left.count() / 1000000000);
+            timeout.tv_nsec = (long)(left.count() % 1000000000);
+            struct pollfd pfd = {_fd, POLLIN, 0};
+            if (ppoll(&pfd, 1, &timeout, NULL) <= 0)
+                break;
+
+            n = recvmmsg(_fd, batch._msgs.data() + batch._count,
+                         (unsigned int)(capacity - batch._count), MSG_DONTWAIT, NULL);
+            if (n <= 0)
+                break;
+            batch._count += (size_t)n;
+        }
+    }
+
+    for (size_t i = 0; i < batch._count; i++)
+        batch._replies[i].clear();
+
+    return batch._count;
+}
+
+void UdpServer::sendBatch(UdpBatch &batch)
+{
+    size_t pending = 0;
+    for (size_t i = 0; i < batch._count; i++)
+    {
+        if (batch._replies[i].empty())
+            continue;
+
+        // compact the replies to send at the start of the header array
+        struct mmsghdr &msg = batch._msgs[pending];
+        msg.msg_hdr.msg_name = &batch._addrs[i];
+        msg.msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        msg.msg_hdr.msg_iov = &batch._iovs[pending];
+        msg.msg_hdr.msg_iovlen = 1;
+        batch._iovs[pending].iov_base = (void *)batch._replies[i].data();
+        batch._iovs[pending].iov_len = batch._replies[i].size();
+        pending++;
+    }
+
+    size_t sent = 0;
+    while (sent < pending)
+    {
+        int n = sendmmsg(_fd, batch._msgs.data() + sent, (unsigned int)(pending - sent), 0);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            sent++; // skip the datagram that failed, as a lost reply
+            continue;
+        }
+        sent += (size_t)n;
+    }
+
+    // restore the receive layout changed above
+    for (size_t i = 0; i < batch.capacity(); i++)
+    {
+        batch._msgs[i].msg_hdr.msg_name = &batch._addrs[i];
+        batch._msgs[i].msg_hdr.msg_iov = &batch._iovs[i];
+        batch._iovs[i].iov_base = batch._buffers[i].data();
+    }
+}
+
 std::string UdpServer::getClientIP()
 {
     struct sockaddr_in *addr = (struct sockaddr_in *)_res->ai_addr;
@@ -67,6 +201,22 @@ std::string UdpServer::getClientPort()
     return std::to_string(ntohs(addr->sin_port));
 }
 
+const struct sockaddr_in &UdpServer::getClientAddress()
+{
+    return *(struct sockaddr_in *)_res->ai_addr;
+}
+
+int UdpServer::queueFill()
+{
+    // SK_MEMINFO_RMEM_ALLOC counts what queued datagrams use of SK_MEMINFO_RCVBUF
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t length = sizeof(meminfo);
+    if (getsockopt(_fd, SOL_SOCKET, SO_MEMINFO, meminfo, &length) < 0 ||
+        meminfo[SK_MEMINFO_RCVBUF] == 0)
+        return 0;
+    return (int)((uint64_t)meminfo[SK_MEMINFO_RMEM_ALLOC] * 100 / meminfo[SK_MEMINFO_RCVBUF]);
+}
+
 UdpServer::~UdpServer()
 {
     freeaddrinfo(_res); // Free the address info
@@ -85,6 +235,41 @@ void UdpServer::closeServer()
     }
 }
 
+UdpBatch::UdpBatch(size_t size)
+    : _msgs(size), _iovs(size), _buffers(size), _addrs(size), _replies(size)
+{
+    memset(_msgs.data(), 0, size * sizeof(struct mmsghdr));
+    for (size_t i = 0; i < size; i++)
+    {
+        _iovs[i].iov_base = _buffers[i].data();
+        _iovs[i].iov_len = BUFFER_SIZE;
+        _msgs[i].msg_hdr.msg_name = &_addrs[i];
+        _msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        _msgs[i].msg_hdr.msg_iov = &_iovs[i];
+        _msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+size_t UdpBatch::capacity()
+{
+    return _msgs.size();
+}
+
+std::string_view UdpBatch::message(size_t i)
+{
+    return std::string_view(_buffers[i].data(), _msgs[i].msg_len);
+}
+
+std::string UdpBatch::getClientIP(size_t i)
+{
+    return inet_ntoa(_addrs[i].sin_addr);
+}
+
+std::string UdpBatch::getClientPort(size_t i)
+{
+    return std::to_string(ntohs(_addrs[i].sin_port));
+}
+
 TcpServer::TcpServer(std::string gsport)
 {
     int errcode;
@@ -115,13 +300,24 @@ TcpServer::TcpServer(std::string gsport)
         throw SocketException();
     }
 
-    if (listen(_fd, 5) == -1) // error
+    if (listen(_fd, TCP_LISTEN_BACKLOG) == -1) // error
     {
         throw SocketException();
     }
     std::cout << "TCP server initialized on port " << gsport << std::endl;
 }
 
+TcpServer::TcpServer(std::string gsport, int fd) : _fd(fd)
+{
+    memset(&_hints, 0, sizeof(_hints));
+    _hints.ai_family = AF_INET;
+    _hints.ai_socktype = SOCK_STREAM;
+    _hints.ai_flags = AI_PASSIVE;
+
+    if (getaddrinfo(NULL, gsport.c_str(), &_hints, &_res) != 0)
+        throw SocketException();
+    std::cout << "TCP server inherited on port " << gsport << std::endl;
+}
 
 std::string TcpServer::getClientIP()
 {
@@ -150,3 +346,29 @@ void TcpServer::closeServer() {
         throw SocketException();
     }
 }
+
+bool sendFileBody(int socket, FileBody &body)
+{
+    while (body._size > 0)
+    {
+        ssize_t n = sendfile(socket, body._fd, &body._offset, body._size);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            // a non-blocking socket is full: the caller waits for it
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        if (n == 0) // the file is shorter than announced
+            return false;
+        body._size -= (size_t)n;
+    }
+    return true;
+}
+
+void closeFileBody(FileBody &body)
+{
+    if (body._fd != -1)
+        close(body._fd);
+    body = FileBody();
+}
@@ -3,6 +3,7 @@
 
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -14,10 +15,39 @@
 #include <cstring>
 #include <stdexcept>
 #include <fcntl.h>
+#include <vector>
+#include <array>
 
 #include "common/constants.hpp"
 #include "common/utils.hpp"
 
+/**
+ * @struct FileBody
+ * @brief Part of a TCP response sent straight from a file, after the encoded header.
+ *
+ * The body is copied from the page cache to the socket by sendfile(), never
+ * through user space.
+ */
+struct FileBody
+{
+    int _fd = -1;      // The file, or -1 if the response has no body
+    off_t _offset = 0; // Next byte of the file to send
+    size_t _size = 0;  // Bytes left to send
+};
+
+/**
+ * @brief Sends as much of a body as the socket accepts.
+ * @param socket The connected socket.
+ * @param body The body, advanced past the bytes sent.
+ * @return false on error. The body is sent once its _size is 0.
+ */
+bool sendFileBody(int socket, FileBody &body);
+
+/**
+ * @brief Closes the file of a body, if any, and leaves it empty.
+ */
+void closeFileBody(FileBody &body);
+
 class TcpServer
 {
 public:
@@ -27,6 +57,13 @@ public:
 
 public:
     TcpServer(std::string gsport);
+
+    /**
+     * @brief Takes over a socket already listening on the given port, e.g.
+     * one handed over by a previous process.
+     */
+    TcpServer(std::string gsport, int fd);
+
     ~TcpServer();
     void closeServer();
 
@@ -34,6 +71,40 @@ public:
     std::string getClientPort();
 };
 
+/**
+ * @class UdpBatch
+ * @brief Buffers used to receive and answer several datagrams per syscall.
+ *
+ * Datagram i of a batch is read into _buffers[i] from the sender stored in
+ * _addrs[i], and _replies[i] is sent back to that same address.
+ */
+class UdpBatch
+{
+public:
+    std::vector<struct mmsghdr> _msgs;                    // recvmmsg/sendmmsg headers
+    std::vector<struct iovec> _iovs;                      // One iovec per datagram
+    std::vector<std::array<char, BUFFER_SIZE>> _buffers; // Received payloads
+    std::vector<struct sockaddr_in> _addrs;               // Senders of the datagrams
+    std::vector<std::string> _replies;                    // Replies to each datagram
+    size_t _count = 0;                                    // Datagrams in the batch
+
+    /**
+     * @brief Constructs a batch able to hold up to size datagrams.
+     */
+    UdpBatch(size_t size);
+
+    size_t capacity();
+
+    /**
+     * @brief Returns the payload of the i-th received datagram, as a view
+     * into the batch that is valid until the next receiveBatch().
+     */
+    std::string_view message(size_t i);
+
+    std::string getClientIP(size_t i);
+    std::string getClientPort(size_t i);
+};
+
 class UdpServer
 {
 private:
@@ -43,14 +114,61 @@ private:
     struct sockaddr_in _addr; // The address
 
 public:
-    UdpServer(std::string gsport);
+    /**
+     * @brief Binds a UDP socket to the given port.
+     * @param reusePort Whether other sockets may bind to the same port.
+     */
+    UdpServer(std::string gsport, bool reusePort = false);
+
+    /**
+     * @brief Takes over a socket already bound to the given port, e.g. one
+     * handed over by a previous process.
+     */
+    UdpServer(std::string gsport, int fd);
+
     ~UdpServer();
+
+    int getFd();
+
     void send(std::string &message);
+    /**
+     * @brief Receives one datagram.
+     * @return The datagram, or an empty string if interrupted or timed out.
+     */
     std::string receive();
+
+    /**
+     * @brief Receives up to batch.capacity() datagrams with recvmmsg.
+     *
+     * Blocks until at least one datagram arrives. If waitUs is 0 it returns
+     * with whatever is queued at that point, otherwise it keeps collecting
+     * datagrams for up to waitUs microseconds or until the batch is full.
+     *
+     * @return The number of datagrams received, 0 if interrupted by a signal
+     * or if nothing arrived within SERVER_POLL_TIMEOUT_MS.
+     */
+    size_t receiveBatch(UdpBatch &batch, int waitUs);
+
+    /**
+     * @brief Sends every reply of the batch to its sender with sendmmsg.
+     */
+    void sendBatch(UdpBatch &batch);
+
     void closeServer();
 
     std::string getClientIP();
     std::string getClientPort();
+
+    /**
+     * @brief The address of the client of the last datagram received.
+     */
+    const struct sockaddr_in &getClientAddress();
+
+    /**
+     * @brief How full the receive queue is.
+     * @return The percentage of the receive buffer in use.
+     */
+    int queueFill();
 };
 
 /**
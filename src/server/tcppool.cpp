@@ -0,0 +1,172 @@
+#include "tcppool.hpp"
+#include "server.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+extern std::atomic<bool> is_exiting;
+
+TcpPool::TcpPool() : _cells(new Cell[TCP_POOL_QUEUE]), _workers(new Worker[TCP_POOL_THREADS])
+{
+    // cell i is free for the push at position i
+    for (size_t i = 0; i < TCP_POOL_QUEUE; i++)
+        _cells[i]._sequence.store(i, std::memory_order_relaxed);
+
+    if (sem_init(&_ready, 0, 0) == -1)
+        throw UnrecoverableError("sem_init", errno);
+}
+
+TcpPool::~TcpPool()
+{
+    sem_destroy(&_ready);
+}
+
+void TcpPool::setThreads(int threads)
+{
+    _threads = threads;
+    _workers.reset(new Worker[(size_t)threads]);
+}
+
+bool TcpPool::push(const Job &job)
+{
+    size_t position = _pushPosition.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true)
+    {
+        cell = &_cells[position & (TCP_POOL_QUEUE - 1)];
+        size_t sequence = cell->_sequence.load(std::memory_order_acquire);
+        if (sequence == position)
+        {
+            if (_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (sequence < position)
+            return false; // not popped yet since the last lap: the queue is full
+        else
+            position = _pushPosition.load(std::memory_order_relaxed);
+    }
+
+    cell->_job = job;
+    cell->_sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool TcpPool::pop(Job &job)
+{
+    size_t position = _popPosition.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true)
+    {
+        cell = &_cells[position & (TCP_POOL_QUEUE - 1)];
+        size_t sequence = cell->_sequence.load(std::memory_order_acquire);
+        if (sequence == position + 1)
+        {
+            if (_popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (sequence < position + 1)
+            return false; // not pushed yet in this lap: the queue is empty
+        else
+            position = _popPosition.load(std::memory_order_relaxed);
+    }
+
+    job = cell->_job;
+    // free for the push one lap later
+    cell->_sequence.store(position + TCP_POOL_QUEUE, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Adds a duration to a total and keeps the longest, for a counter
+ * written by a single thread.
+ */
+static void account(std::atomic<uint64_t> &total, std::atomic<uint64_t> &longest, uint64_t us)
+{
+    total.fetch_add(us, std::memory_order_relaxed);
+    if (us > longest.load(std::memory_order_relaxed))
+        longest.store(us, std::memory_order_relaxed);
+}
+
+void TcpPool::work(Worker &worker, CommandManager &manager, Server &server)
+{
+    while (true)
+    {
+        while (sem_wait(&_ready) == -1 && errno == EINTR)
+            ;
+
+        // a connection, or a wake-up once every connection was pushed
+        Job job;
+        if (!pop(job))
+            return;
+
+        auto started = std::chrono::steady_clock::now();
+        serveTcpConnection(job._fd, job._addr, manager, server);
+        close(job._fd);
+        auto served = std::chrono::steady_clock::now();
+
+        worker._requests.fetch_add(1, std::memory_order_relaxed);
+        account(worker._waitTotalUs, worker._waitMaxUs,
+                (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(started - job._accepted).count());
+        account(worker._serviceTotalUs, worker._serviceMaxUs,
+                (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(served - started).count());
+    }
+}
+
+void TcpPool::run(TcpServer &tcpServer, CommandManager &manager, Server &server)
+{
+    std::vector<std::thread> threads;
+    for (int i = 0; i < _threads; i++)
+        threads.emplace_back(&TcpPool::work, this, std::ref(_workers[(size_t)i]),
+                             std::ref(manager), std::ref(server));
+
+    while (!is_exiting)
+    {
+        // wait for a connection for a while, so a shutdown is noticed
+        struct pollfd pfd = {tcpServer._fd, POLLIN, 0};
+        if (poll(&pfd, 1, SERVER_POLL_TIMEOUT_MS) <= 0)
+            continue;
+
+        Job job;
+        socklen_t addrlen = sizeof(job._addr);
+        job._fd = accept4(tcpServer._fd, (struct sockaddr *)&job._addr, &addrlen, SOCK_CLOEXEC);
+        if (job._fd == -1)
+        {
+            // the listening socket may be non-blocking, if inherited from the epoll model
+            if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN && errno != EWOULDBLOCK)
+                std::cerr << "Error: accept: " << strerror(errno) << std::endl;
+            continue;
+        }
+        job._accepted = std::chrono::steady_clock::now();
+
+        // with every worker busy and the queue full, the next connections
+        // wait in the listen backlog
+        while (!push(job))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        sem_post(&_ready);
+    }
+
+    // every accepted connection is served before the workers stop
+    for (size_t i = 0; i < threads.size(); i++)
+        sem_post(&_ready);
+    for (auto &thread : threads)
+        thread.join();
+}
+
+std::vector<TcpWorkerStats> TcpPool::stats()
+{
+    std::vector<TcpWorkerStats> stats((size_t)_threads);
+    for (size_t i = 0; i < stats.size(); i++)
+    {
+        stats[i]._requests = _workers[i]._requests.load(std::memory_order_relaxed);
+        stats[i]._waitTotalUs = _workers[i]._waitTotalUs.load(std::memory_order_relaxed);
+        stats[i]._waitMaxUs = _workers[i]._waitMaxUs.load(std::memory_order_relaxed);
+        stats[i]._serviceTotalUs = _workers[i]._serviceTotalUs.load(std::memory_order_relaxed);
+        stats[i]._serviceMaxUs = _workers[i]._serviceMaxUs.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
@@ -0,0 +1,120 @@
+#ifndef TCPPOOL_H
+#define TCPPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <netinet/in.h>
+#include <semaphore.h>
+
+#include "../common/constants.hpp"
+#include "socket.hpp"
+
+class CommandManager;
+class Server;
+
+/**
+ * @brief Counters of one worker of a TcpPool, since the server started.
+ */
+struct TcpWorkerStats
+{
+    uint64_t _requests = 0;       // Connections served
+    uint64_t _waitTotalUs = 0;    // Time they waited in the queue, in microseconds
+    uint64_t _waitMaxUs = 0;      // Longest of those waits
+    uint64_t _serviceTotalUs = 0; // Time spent serving them, in microseconds
+    uint64_t _serviceMaxUs = 0;   // Longest of those services
+};
+
+/**
+ * @class TcpPool
+ * @brief Serves the TCP requests (STR/SSB) from a fixed pool of threads.
+ *
+ * One thread accepts the connections and pushes them to a bounded lock-free
+ * queue of TCP_POOL_QUEUE entries, from which the workers pop them and serve
+ * one request each, as a forked child of TCPServer() would, but without the
+ * fork. The workers only sleep on a semaphore when the queue is empty, and
+ * when it is full the connections wait in the listen backlog.
+ *
+ * The queue is a ring of cells, each with a sequence number telling whether
+ * it holds a connection for the current lap, so pushing and popping only
+ * take a compare-and-swap on the position.
+ */
+class TcpPool
+{
+private:
+    struct Job
+    {
+        int _fd;                                          // The accepted connection
+        struct sockaddr_in _addr;                         // The address of the peer
+        std::chrono::steady_clock::time_point _accepted; // When it was accepted
+    };
+
+    struct Cell
+    {
+        std::atomic<size_t> _sequence; // Position of the lap it may be pushed, or popped, at
+        Job _job;
+    };
+
+    // Updated by its worker only, read by the statistics
+    struct Worker
+    {
+        std::atomic<uint64_t> _requests{0};
+        std::atomic<uint64_t> _waitTotalUs{0};
+        std::atomic<uint64_t> _waitMaxUs{0};
+        std::atomic<uint64_t> _serviceTotalUs{0};
+        std::atomic<uint64_t> _serviceMaxUs{0};
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    alignas(64) std::atomic<size_t> _pushPosition{0};
+    alignas(64) std::atomic<size_t> _popPosition{0};
+    sem_t _ready; // Connections in the queue, plus a wake-up per worker when stopping
+
+    int _threads = TCP_POOL_THREADS;
+    std::unique_ptr<Worker[]> _workers;
+
+    /**
+     * @brief Adds a connection to the queue.
+     * @return false if the queue is full.
+     */
+    bool push(const Job &job);
+
+    /**
+     * @brief Takes the oldest connection of the queue.
+     * @return false if the queue is empty.
+     */
+    bool pop(Job &job);
+
+    /**
+     * @brief Serves connections until woken up with the queue empty.
+     */
+    void work(Worker &worker, CommandManager &manager, Server &server);
+
+public:
+    TcpPool();
+    TcpPool(const TcpPool &) = delete;
+    TcpPool &operator=(const TcpPool &) = delete;
+    ~TcpPool();
+
+    /**
+     * @brief Sets the number of worker threads, before the pool runs.
+     */
+    void setThreads(int threads);
+
+    /**
+     * @brief Accepts the connections of tcpServer and serves them until the
+     * server starts exiting, then waits for the workers to serve the
+     * connections already accepted.
+     */
+    void run(TcpServer &tcpServer, CommandManager &manager, Server &server);
+
+    /**
+     * @brief Gets the counters of each worker.
+     */
+    std::vector<TcpWorkerStats> stats();
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include "timerwheel.hpp"
+
+TimerWheel::TimerWheel(time_t now) : _now(now)
+{
+}
+
+void TimerWheel::place(Timer timer, const std::function<void(int)> &expired)
+{
+    time_t delta = timer._deadline - _now;
+    if (delta <= 0)
+    {
+        _size--;
+        expired(timer._id);
+        return;
+    }
+
+    // deadlines past the last level wait in its furthest slot, and are
+    // placed again when it is reached
+    time_t slotTime = delta < SPAN ? timer._deadline : _now + SPAN - 1;
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (time_t)1 << (TIMER_WHEEL_BITS * (level + 1)))
+        level++;
+
+    size_t slot = (size_t)(slotTime >> (TIMER_WHEEL_BITS * level)) & (SLOTS - 1);
+    _levels[(size_t)level][slot].push_back(timer);
+}
+
+void TimerWheel::tick(const std::function<void(int)> &expired)
+{
+    _now++;
+
+    // every time a level wraps around, the next slot of the level above is
+    // spread over the levels below
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        if ((_now & (((time_t)1 << (TIMER_WHEEL_BITS * level)) - 1)) != 0)
+            break;
+
+        size_t slot = (size_t)(_now >> (TIMER_WHEEL_BITS * level)) & (SLOTS - 1);
+        std::vector<Timer> timers;
+        timers.swap(_levels[(size_t)level][slot]);
+        for (Timer &timer : timers)
+            place(timer, expired);
+    }
+
+    std::vector<Timer> &timers = _levels[0][(size_t)_now & (SLOTS - 1)];
+    for (Timer &timer : timers)
+    {
+        _size--;
+        expired(timer._id);
+    }
+    timers.clear();
+}
+
+void TimerWheel::schedule(int id, time_t deadline)
+{
+    _size++;
+    if (deadline <= _now)
+        _due.push_back(Timer{id, deadline});
+    else
+        place(Timer{id, deadline}, nullptr);
+}
+
+void TimerWheel::advance(time_t now, const std::function<void(int)> &expired)
+{
+    for (Timer &timer : _due)
+    {
+        _size--;
+        expired(timer._id);
+    }
+    _due.clear();
+
+    if (now - _now >= SPAN)
+    {
+        // the clock jumped past the whole wheel: place every timer again
+        std::vector<Timer> timers;
+        for (auto &level : _levels)
+            for (auto &slot : level)
+            {
+                timers.insert(timers.end(), slot.begin(), slot.end());
+                slot.clear();
+            }
+
+        _now = now;
+        for (Timer &timer : timers)
+            place(timer, expired);
+        return;
+    }
+
+    while (_now < now)
+        tick(expired);
+}
+
+size_t TimerWheel::size() const
+{
+    return _size;
+}
@@ -0,0 +1,77 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <array>
+#include <ctime>
+#include <functional>
+#include <vector>
+
+#include "../common/constants.hpp"
+
+/**
+ * @class TimerWheel
+ * @brief Hierarchical timer wheel with a resolution of one second.
+ *
+ * Level 0 has one slot per second for the next TIMER_WHEEL_SLOTS seconds,
+ * and each level above it covers TIMER_WHEEL_SLOTS times the span of the one
+ * below. A timer is placed in the lowest level that reaches its deadline and
+ * moves down a level when the wheel gets to its slot, so scheduling and
+ * expiring a timer take O(1) amortized time, whatever the number of timers.
+ * Timers are never cancelled: whoever handles an expired one checks whether
+ * it still applies.
+ */
+class TimerWheel
+{
+private:
+    struct Timer
+    {
+        int _id;          // What the timer is for
+        time_t _deadline; // When it expires
+    };
+
+    static const int SLOTS = 1 << TIMER_WHEEL_BITS;
+    static const time_t SPAN = (time_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+
+    std::array<std::array<std::vector<Timer>, SLOTS>, TIMER_WHEEL_LEVELS> _levels;
+    std::vector<Timer> _due; // Timers whose deadline had passed when scheduled
+    time_t _now;             // Time the wheel has advanced to
+    size_t _size = 0;        // Number of scheduled timers
+
+    /**
+     * @brief Places a timer in its slot, or in expired if its deadline has passed.
+     */
+    void place(Timer timer, const std::function<void(int)> &expired);
+
+    /**
+     * @brief Advances the wheel by one second, expiring the timers of that second.
+     */
+    void tick(const std::function<void(int)> &expired);
+
+public:
+    /**
+     * @brief Creates an empty wheel.
+     * @param now The current time.
+     */
+    TimerWheel(time_t now);
+
+    /**
+     * @brief Schedules a timer. A deadline that has passed expires on the next advance().
+     * @param id What the timer is for.
+     * @param deadline When it expires.
+     */
+    void schedule(int id, time_t deadline);
+
+    /**
+     * @brief Expires every timer whose deadline is up to now.
+     * @param now The current time.
+     * @param expired Called with the id of each expired timer.
+     */
+    void advance(time_t now, const std::function<void(int)> &expired);
+
+    /**
+     * @brief Gets the number of scheduled timers.
+     */
+    size_t size() const;
+};
+
+#endif
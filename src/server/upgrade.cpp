@@ -0,0 +1,185 @@
+#include "upgrade.hpp"
+#include "../common/utils.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern std::atomic<bool> is_exiting;
+extern char **environ;
+
+std::atomic<bool> upgrade_requested(false);
+
+// The single bytes exchanged over the handoff channel
+#define HANDOFF_SOCKETS 'S' // Sent with the sockets, once the game data is stable
+#define HANDOFF_TAKEN 'T'   // Sent back once the new process has loaded the games
+
+static void upgrade_signal_handler(int sig)
+{
+    (void)sig;
+    if (is_exiting) // already shutting down or upgrading
+        return;
+
+    // set first, so whoever sees is_exiting also sees why
+    upgrade_requested = true;
+    is_exiting = true;
+}
+
+void setup_upgrade_signal_handler()
+{
+    struct sigaction sa;
+    sa.sa_handler = upgrade_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+
+    if (sigaction(SIGUSR2, &sa, NULL) == -1)
+        throw UnrecoverableError("Setting SIGUSR2 signal handler", errno);
+}
+
+bool receiveHandoff(Handoff &handoff)
+{
+    const char *channel = getenv(UPGRADE_ENV);
+    if (channel == nullptr)
+        return false;
+
+    handoff._channel = atoi(channel);
+    unsetenv(UPGRADE_ENV);
+    fcntl(handoff._channel, F_SETFD, FD_CLOEXEC); // not for a later upgrade
+
+    char byte = 0;
+    struct iovec iov = {&byte, 1};
+    char control[CMSG_SPACE(sizeof(int) * (1 + UDP_MAX_WORKERS))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    // blocks until the previous process stopped changing the games
+    ssize_t n;
+    do
+        n = recvmsg(handoff._channel, &msg, MSG_CMSG_CLOEXEC);
+    while (n == -1 && errno == EINTR);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (n != 1 || byte != HANDOFF_SOCKETS || cmsg == nullptr ||
+        cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        throw UnrecoverableError("Upgrade: no sockets received from the previous process");
+
+    size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    if (count < 2)
+        throw UnrecoverableError("Upgrade: no sockets received from the previous process");
+
+    std::vector<int> fds(count);
+    memcpy(fds.data(), CMSG_DATA(cmsg), count * sizeof(int));
+    handoff._tcpFd = fds[0];
+    handoff._udpFds.assign(fds.begin() + 1, fds.end());
+    return true;
+}
+
+void acknowledgeHandoff(Handoff &handoff)
+{
+    char byte = HANDOFF_TAKEN;
+    if (send(handoff._channel, &byte, 1, MSG_NOSIGNAL) != 1)
+        std::cerr << "Error: upgrade: the previous process is gone" << std::endl;
+    close(handoff._channel);
+    handoff._channel = -1;
+}
+
+/**
+ * @brief Sends the listening sockets, TCP first, over the channel.
+ */
+static bool sendSockets(int channel, int tcpFd, const std::vector<int> &udpFds)
+{
+    std::vector<int> fds = {tcpFd};
+    fds.insert(fds.end(), udpFds.begin(), udpFds.end());
+
+    char byte = HANDOFF_SOCKETS;
+    struct iovec iov = {&byte, 1};
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+    return sendmsg(channel, &msg, MSG_NOSIGNAL) == 1;
+}
+
+/**
+ * @brief Waits up to UPGRADE_TIMEOUT seconds for the new process to take over.
+ */
+static bool waitTakeover(int channel)
+{
+    struct pollfd pfd = {channel, POLLIN, 0};
+    int ready;
+    do
+        ready = poll(&pfd, 1, UPGRADE_TIMEOUT * 1000);
+    while (ready == -1 && errno == EINTR);
+
+    char byte = 0;
+    return ready == 1 && read(channel, &byte, 1) == 1 && byte == HANDOFF_TAKEN;
+}
+
+bool handOver(char **argv, int tcpFd, const std::vector<int> &udpFds)
+{
+    int channel[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) == -1)
+    {
+        std::cerr << "Error: upgrade: socketpair: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // the environment is built before forking, as the other threads may
+    // hold the allocator's locks
+    std::string variable = UPGRADE_ENV "=" + std::to_string(channel[1]);
+    std::vector<char *> envp;
+    for (char **env = environ; *env != nullptr; env++)
+        if (strncmp(*env, UPGRADE_ENV "=", strlen(UPGRADE_ENV) + 1) != 0)
+            envp.push_back(*env);
+    envp.push_back(variable.data());
+    envp.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        std::cerr << "Error: upgrade: fork: " << strerror(errno) << std::endl;
+        close(channel[0]);
+        close(channel[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        // the new process keeps its end of the channel across the exec
+        fcntl(channel[1], F_SETFD, 0);
+        execvpe(argv[0], argv, envp.data());
+        _exit(EXIT_FAILURE);
+    }
+    close(channel[1]);
+
+    bool taken = sendSockets(channel[0], tcpFd, udpFds) && waitTakeover(channel[0]);
+    close(channel[0]);
+
+    if (!taken) // never serve from two processes
+    {
+        std::cerr << "Error: upgrade: the new process did not take over" << std::endl;
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+    return taken;
+}
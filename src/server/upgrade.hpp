@@ -0,0 +1,67 @@
+#ifndef UPGRADE_H
+#define UPGRADE_H
+
+#include <atomic>
+#include <vector>
+
+#include "../common/constants.hpp"
+
+/**
+ * Hot upgrade: on SIGUSR2 the running GS execs its binary again, which may
+ * have been replaced meanwhile, and hands the new process its listening
+ * sockets over a Unix socket (SCM_RIGHTS). The datagrams and connections
+ * arriving in between wait in the sockets' queues, so none is lost.
+ *
+ * The ongoing games are handed over through the journal: the old process
+ * stops changing them before the handoff, and the new one replays it on
+ * startup, as after a restart. Once the new process has loaded the games it
+ * acknowledges the handoff, and the old one drains its TCP connections and
+ * exits without quitting the games.
+ */
+
+/**
+ * @brief Set by SIGUSR2, along with is_exiting.
+ */
+extern std::atomic<bool> upgrade_requested;
+
+/**
+ * @brief The listening sockets handed over by the previous process.
+ */
+struct Handoff
+{
+    int _channel = -1;        // Where to acknowledge the handoff, -1 if none
+    int _tcpFd = -1;          // The TCP listening socket
+    std::vector<int> _udpFds; // The UDP sockets, one per worker
+};
+
+/**
+ * @brief Makes SIGUSR2 request an upgrade.
+ * @throws UnrecoverableError if the handler could not be set.
+ */
+void setup_upgrade_signal_handler();
+
+/**
+ * @brief Receives the sockets of the previous process, if this process was
+ * started by a hot upgrade. Blocks until that process stopped changing the
+ * game data.
+ * @return false if this process was not started by an upgrade.
+ * @throws UnrecoverableError if the handoff failed.
+ */
+bool receiveHandoff(Handoff &handoff);
+
+/**
+ * @brief Tells the previous process that this one has taken over.
+ */
+void acknowledgeHandoff(Handoff &handoff);
+
+/**
+ * @brief Execs the binary again and hands it the listening sockets.
+ *
+ * The game data must not change from then on.
+ * @param argv The arguments of this process, reused by the new one.
+ * @return true once the new process acknowledged the handoff, false if it
+ * failed to start, in which case this process should carry on.
+ */
+bool handOver(char **argv, int tcpFd, const std::vector<int> &udpFds);
+
+#endif
@@ -0,0 +1,188 @@
+#include "uring.hpp"
+#include "../common/utils.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The features the rings are used with: one mapping for both rings
+// (Linux 5.4), no lost completions (5.5) and timed waits (5.11)
+#define URING_FEATURES (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)
+
+// Longest wait for completions when the kernel is short of resources
+#define URING_BACKOFF_NS 1000000
+
+static int uringSetup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags,
+                      const void *arg, size_t argSize)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+IoUring::IoUring(unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    _fd = uringSetup(entries, &params);
+    if (_fd == -1)
+        throw UnrecoverableError("io_uring_setup", errno);
+    if ((params.features & URING_FEATURES) != URING_FEATURES)
+    {
+        close(_fd);
+        throw UnrecoverableError("io_uring: the kernel is too old");
+    }
+
+    // with IORING_FEAT_SINGLE_MMAP the completion ring shares the mapping
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    _ringsSize = sqSize > cqSize ? sqSize : cqSize;
+    _rings = mmap(NULL, _ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd,
+                  IORING_OFF_SQ_RING);
+    if (_rings == MAP_FAILED)
+    {
+        _rings = nullptr;
+        close(_fd);
+        throw UnrecoverableError("io_uring: mmap", errno);
+    }
+
+    _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        munmap(_rings, _ringsSize);
+        close(_fd);
+        throw UnrecoverableError("io_uring: mmap", errno);
+    }
+    _sqes = (struct io_uring_sqe *)sqes;
+
+    char *rings = (char *)_rings;
+    _sqHead = (unsigned *)(rings + params.sq_off.head);
+    _sqTail = (unsigned *)(rings + params.sq_off.tail);
+    _sqMask = *(unsigned *)(rings + params.sq_off.ring_mask);
+    _sqEntries = params.sq_entries;
+    _sqArray = (unsigned *)(rings + params.sq_off.array);
+    _sqLocalTail = *_sqTail;
+
+    _cqHead = (unsigned *)(rings + params.cq_off.head);
+    _cqTail = (unsigned *)(rings + params.cq_off.tail);
+    _cqMask = *(unsigned *)(rings + params.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe *)(rings + params.cq_off.cqes);
+}
+
+IoUring::~IoUring()
+{
+    // the kernel cancels what is still in flight once the ring is closed
+    munmap(_sqes, _sqesSize);
+    munmap(_rings, _ringsSize);
+    close(_fd);
+}
+
+bool IoUring::supported()
+{
+    try
+    {
+        IoUring ring(1);
+        return true;
+    }
+    catch (UnrecoverableError &e)
+    {
+        return false;
+    }
+}
+
+struct io_uring_sqe *IoUring::prepare(uint8_t opcode, int fd, const void *addr, uint32_t len,
+                                      uint64_t offset, uint64_t userData)
+{
+    // the kernel moves the head once it consumed the entries
+    if (_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries)
+        return nullptr;
+
+    unsigned index = _sqLocalTail & _sqMask;
+    struct io_uring_sqe *sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = userData;
+
+    _sqArray[index] = index;
+    _sqLocalTail++;
+    _unsubmitted++;
+    return sqe;
+}
+
+unsigned IoUring::space() const
+{
+    return _sqEntries - (_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE));
+}
+
+bool IoUring::submit(unsigned waitFor, int timeoutMs)
+{
+    // the entries are written before the kernel may see the new tail
+    __atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+
+    struct __kernel_timespec timeout;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeoutMs >= 0)
+    {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (long long)(timeoutMs % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&timeout;
+    }
+
+    unsigned flags = IORING_ENTER_EXT_ARG | (waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+    while (true)
+    {
+        int n = uringEnter(_fd, _unsubmitted, waitFor, flags, &arg, sizeof(arg));
+        if (n > 0 && (unsigned)n < _unsubmitted)
+        {
+            // the kernel stopped short, without waiting: the rest is
+            // submitted again, which ends as every call takes some
+            _unsubmitted -= (unsigned)n;
+            continue;
+        }
+        if (n >= 0)
+        {
+            _unsubmitted -= (unsigned)n;
+            return _unsubmitted == 0;
+        }
+
+        // the entries are taken even if the wait is cut short
+        _unsubmitted = _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+        if (errno == ETIME || errno == EINTR)
+            return false;
+        if (errno != EAGAIN && errno != EBUSY)
+            throw UnrecoverableError("io_uring_enter", errno);
+
+        // out of resources until some operations complete and are reaped:
+        // give them a moment, and leave the entries to the next submit()
+        timeout.tv_sec = 0;
+        timeout.tv_nsec = URING_BACKOFF_NS;
+        arg.ts = (uint64_t)(uintptr_t)&timeout;
+        uringEnter(_fd, 0, 1, IORING_ENTER_EXT_ARG | IORING_ENTER_GETEVENTS, &arg, sizeof(arg));
+        return false;
+    }
+}
+
+bool IoUring::completion(struct io_uring_cqe &cqe)
+{
+    unsigned head = *_cqHead;
+    if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+        return false;
+
+    cqe = _cqes[head & _cqMask];
+    __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
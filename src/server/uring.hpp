@@ -0,0 +1,103 @@
+#ifndef URING_H
+#define URING_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+
+/**
+ * @brief How the server waits for its socket and file I/O.
+ */
+enum class IoEngine
+{
+    Blocking, // a blocking syscall per operation, or per recvmmsg/sendmmsg batch
+    Uring     // operations submitted to an io_uring and completed in batches
+};
+
+/**
+ * @class IoUring
+ * @brief A minimal io_uring instance, set up with the raw syscalls.
+ *
+ * Operations are prepared in the submission queue with prepare(), sent to
+ * the kernel by the next submit(), and their results read back, in any
+ * order, with completion(). A ring is used by a single thread.
+ */
+class IoUring
+{
+private:
+    int _fd = -1;
+
+    void *_rings = nullptr; // Submission and completion rings, mapped together
+    size_t _ringsSize = 0;
+    struct io_uring_sqe *_sqes = nullptr;
+    size_t _sqesSize = 0;
+
+    unsigned *_sqHead;
+    unsigned *_sqTail;
+    unsigned _sqMask;
+    unsigned _sqEntries;
+    unsigned *_sqArray;
+    unsigned _sqLocalTail = 0; // Prepared up to here, published by submit()
+    unsigned _unsubmitted = 0; // Prepared since the last submit()
+
+    unsigned *_cqHead;
+    unsigned *_cqTail;
+    unsigned _cqMask;
+    struct io_uring_cqe *_cqes;
+
+public:
+    /**
+     * @brief Sets up a ring of at least entries submission entries.
+     * @throws UnrecoverableError if the kernel does not support io_uring,
+     * or lacks a feature it needs.
+     */
+    IoUring(unsigned entries);
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+    ~IoUring();
+
+    /**
+     * @brief Checks if a ring can be set up, e.g. it is not disabled by the
+     * kernel or a seccomp policy.
+     */
+    static bool supported();
+
+    /**
+     * @brief Prepares an operation in the submission queue.
+     * @param opcode IORING_OP_*.
+     * @param fd The file descriptor it operates on.
+     * @param addr Its buffer, or msghdr for IORING_OP_RECVMSG/SENDMSG.
+     * @param len Length of the buffer.
+     * @param offset File offset.
+     * @param userData Returned with its completion.
+     * @return The entry, to set more fields on, or nullptr if the queue is
+     * full until the next submit(): see space().
+     */
+    struct io_uring_sqe *prepare(uint8_t opcode, int fd, const void *addr, uint32_t len,
+                                 uint64_t offset, uint64_t userData);
+
+    /**
+     * @brief Gets how many more operations can be prepared before the next
+     * submit().
+     */
+    unsigned space() const;
+
+    /**
+     * @brief Submits the prepared operations and waits for completions.
+     * @param waitFor Completions to wait for, 0 not to wait.
+     * @param timeoutMs Longest wait, -1 for no limit.
+     * @return false if the wait timed out or was interrupted by a signal, or
+     * if some operations are left in the queue, the kernel being short of
+     * resources until the completions are reaped.
+     */
+    bool submit(unsigned waitFor, int timeoutMs);
+
+    /**
+     * @brief Takes the next completion.
+     * @return false if no operation completed since the last call.
+     */
+    bool completion(struct io_uring_cqe &cqe);
+};
+
+#endif